@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Compare the heatmap accumulation strategies (--heat-accum) in time and memory on one node.
+# Usage: ./bench_heatmaps.sh [folder] ; set LAUNCHER to e.g. "srun -n 1" on the cluster.
+
+folder=${1:-events}
+launcher=${LAUNCHER:-"mpirun -np 1"}
+cpus_per_task_list=(2 4 8 16 32 48 64 96 128)
+heat_accum_list=(private atomic owner partition)
+
+echo "mode,cpus,working_set_mb,peak_rss_mb,time"
+for cpus_per_task in "${cpus_per_task_list[@]}"; do
+    for mode in "${heat_accum_list[@]}"; do
+        output=$(OMP_NUM_THREADS=$cpus_per_task $launcher ./mpi_hm_open_mp.exe --folder $folder --heat-accum $mode)
+
+        working_set=$(echo "$output" | grep -m1 "Heatmap accumulation" | sed 's/.*(\([0-9.]*\) MB.*/\1/')
+        peak_rss=$(echo "$output" | grep -m1 "peak RSS" | awk '{print $(NF-1)}')
+        elapsed=$(echo "$output" | grep "Maximum elapsed time" | awk '{print $(NF-1)}')
+
+        echo "$mode,$cpus_per_task,$working_set,$peak_rss,$elapsed"
+    done
+done
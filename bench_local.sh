@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Self-contained benchmark on one Linux box: generates synthetic recordings (once) and sweeps
+# MPI ranks x OpenMP threads, printing the time and throughput of every phase as CSV.
+# Usage: ./bench_local.sh [extra program options] ; e.g. ./bench_local.sh --schedule split
+# Environment: NP_LIST, THREADS_LIST, EVENTS, FILES, FOLDER, EXE, LAUNCHER, GEN_ARGS
+
+np_list=(${NP_LIST:-1 2 4})
+threads_list=(${THREADS_LIST:-1 2 4 8})
+events=${EVENTS:-2000000}
+files=${FILES:-8}
+folder=${FOLDER:-bench_events}
+exe=${EXE:-./mpi_open_mp.exe}
+launcher=${LAUNCHER:-"mpirun --oversubscribe -np"}
+
+if [ ! -d "$folder" ]; then
+    ./gen_events.exe --folder $folder --events $events --files $files $GEN_ARGS > /dev/null || exit 1
+fi
+mkdir -p histograms heatmaps
+
+echo "np,threads,phase,time,mev_s,mb_s,elapsed"
+for np in "${np_list[@]}"; do
+    for threads in "${threads_list[@]}"; do
+        output=$(OMP_NUM_THREADS=$threads $launcher $np $exe --folder $folder "$@")
+
+        elapsed=$(echo "$output" | grep "Maximum elapsed time" | awk '{print $(NF-1)}')
+        echo "$output" | grep "^Phase " | while read -r _ phase time _ mev _ mb _; do
+            echo "$np,$threads,${phase%:},${time%,},$mev,$mb,$elapsed"
+        done
+    done
+done
@@ -0,0 +1,72 @@
+import numpy as np
+import struct
+import sys
+
+'''
+Reads the result containers written with --container (one file holding the histogram and
+heatmap of every input file, see the container format in gpu_mpi_common_open_mp.c)
+'''
+
+MAGIC = b'EVR1'
+HEADER = struct.Struct('<4sIQQQQIIII8x')
+ENTRY = struct.Struct('<QII')
+
+
+def is_container(path):
+    with open(path, 'rb') as f:
+        return f.read(4) == MAGIC
+
+
+def read_index(path):
+    # Header fields, and the record offset of each base name
+    with open(path, 'rb') as f:
+        fields = HEADER.unpack(f.read(HEADER.size))
+        magic, version, nb_files, index_offset, data_offset, record_bytes, millis, width, height, outputs = fields
+        if magic != MAGIC or version != 1:
+            raise ValueError(f"{path} is not a result container")
+        f.seek(index_offset)
+        entries = [ENTRY.unpack(f.read(ENTRY.size)) for _ in range(nb_files)]
+        names = f.read()
+
+    header = {'nb_files': nb_files, 'record_bytes': record_bytes, 'millis': millis,
+              'width': width, 'height': height,
+              'histograms': bool(outputs & 1), 'heatmaps': bool(outputs & 2)}
+    index = {}
+    for record_offset, name_offset, name_length in entries:
+        index[names[name_offset:name_offset + name_length].decode()] = record_offset
+    return header, index
+
+
+def _record(path, base_name):
+    header, index = read_index(path)
+    if base_name not in index:
+        raise KeyError(f"{base_name} is not in {path}")
+    return header, index[base_name]
+
+
+def load_histogram(path, base_name):
+    header, offset = _record(path, base_name)
+    if not header['histograms']:
+        raise ValueError(f"{path} holds no histograms")
+    return np.fromfile(path, dtype=np.uint32, count=header['millis'], offset=offset)
+
+
+def load_heatmap(path, base_name):
+    header, offset = _record(path, base_name)
+    if not header['heatmaps']:
+        raise ValueError(f"{path} holds no heatmaps")
+    if header['histograms']:
+        offset += header['millis'] * 4
+    count = header['width'] * header['height']
+    return np.fromfile(path, dtype=np.uint32, count=count, offset=offset).reshape((header['width'], header['height']))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: python container_reader.py <container>")
+        sys.exit(1)
+
+    header, index = read_index(sys.argv[1])
+    print(f"{header['nb_files']} file(s), {header['record_bytes']} bytes per record")
+    for name, offset in index.items():
+        print(f"{offset:>12}  {name}")
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "event_format.h"
+
+// Converts raw event recordings (4-byte count + 12-byte records) to the columnar EVC1
+// format read by gpu_mpi_common_open_mp.c, and back with --to-raw.
+
+#define EVENT_SIZE_BYTES 12
+
+// Load a whole file into memory
+unsigned char *load_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Error: Could not open file %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char *data = malloc(length > 0 ? (size_t)length : 1);
+    if (data == NULL || fread(data, 1, (size_t)length, file) != (size_t)length) {
+        printf("Error: Could not read file %s\n", path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+// Smallest delta width able to hold every timestamp of a block relative to its minimum
+uint32_t delta_width(uint64_t span) {
+    if (span <= UINT16_MAX) {
+        return 2;
+    }
+    if (span <= UINT32_MAX) {
+        return 4;
+    }
+    return 8;
+}
+
+int raw_to_columnar(const unsigned char *raw, size_t raw_size, uint32_t block_events, FILE *output) {
+    uint32_t count;
+    memcpy(&count, raw, sizeof(count));
+    if (count > (raw_size - sizeof(count)) / EVENT_SIZE_BYTES) {
+        printf("Error: Header announces %u events but the file holds %zu\n",
+               count, (raw_size - sizeof(count)) / EVENT_SIZE_BYTES);
+        return 1;
+    }
+    const unsigned char *records = raw + sizeof(count);
+
+    ColumnarHeader header = {0};
+    memcpy(header.magic, COLUMNAR_MAGIC, 4);
+    header.version = COLUMNAR_VERSION;
+    header.total_events = count;
+    header.block_events = block_events;
+    header.nb_blocks = (count + block_events - 1) / block_events;
+    header.flags = COLUMNAR_FLAG_SORTED;
+    if (count > 0) {
+        memcpy(&header.first_timestamp, records, sizeof(uint64_t));
+    }
+
+    ColumnarBlock *blocks = calloc(header.nb_blocks > 0 ? header.nb_blocks : 1, sizeof(ColumnarBlock));
+    unsigned char *column = malloc((size_t)block_events * (sizeof(uint64_t) + 2 * sizeof(uint16_t)));
+    if (blocks == NULL || column == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // First pass: block bounds, delta widths, offsets and sortedness
+    uint64_t offset = sizeof(ColumnarHeader) + (uint64_t)header.nb_blocks * sizeof(ColumnarBlock);
+    uint64_t previous = header.first_timestamp;
+    for (uint32_t b = 0; b < header.nb_blocks; b++) {
+        uint32_t first = b * block_events;
+        uint32_t n = (count - first < block_events) ? count - first : block_events;
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (uint32_t e = first; e < first + n; e++) {
+            uint64_t timestamp;
+            memcpy(&timestamp, records + (size_t)e * EVENT_SIZE_BYTES, sizeof(uint64_t));
+            lo = timestamp < lo ? timestamp : lo;
+            hi = timestamp > hi ? timestamp : hi;
+            if (timestamp < previous) {
+                header.flags &= ~COLUMNAR_FLAG_SORTED;
+            }
+            previous = timestamp;
+        }
+
+        offset = (offset + 7) & ~(uint64_t)7;
+        blocks[b].offset = offset;
+        blocks[b].base_timestamp = lo;
+        blocks[b].count = n;
+        blocks[b].ts_bytes = delta_width(hi - lo);
+        offset += columnar_block_bytes(&blocks[b]);
+    }
+
+    fwrite(&header, sizeof(header), 1, output);
+    fwrite(blocks, sizeof(ColumnarBlock), header.nb_blocks, output);
+    long position = (long)(sizeof(ColumnarHeader) + (size_t)header.nb_blocks * sizeof(ColumnarBlock));
+
+    // Second pass: write each block as its timestamp, x and y columns
+    static const unsigned char padding[8] = {0};
+    for (uint32_t b = 0; b < header.nb_blocks; b++) {
+        const ColumnarBlock *block = &blocks[b];
+        const unsigned char *block_records = records + (size_t)b * block_events * EVENT_SIZE_BYTES;
+        unsigned char *x_column = column + (size_t)block->count * block->ts_bytes;
+        unsigned char *y_column = x_column + (size_t)block->count * sizeof(uint16_t);
+
+        for (uint32_t k = 0; k < block->count; k++) {
+            const unsigned char *record = block_records + (size_t)k * EVENT_SIZE_BYTES;
+            uint64_t timestamp;
+            memcpy(&timestamp, record, sizeof(uint64_t));
+            uint64_t delta = timestamp - block->base_timestamp;
+            if (block->ts_bytes == 2) {
+                uint16_t d = (uint16_t)delta;
+                memcpy(column + k * 2, &d, 2);
+            } else if (block->ts_bytes == 4) {
+                uint32_t d = (uint32_t)delta;
+                memcpy(column + k * 4, &d, 4);
+            } else {
+                memcpy(column + (size_t)k * 8, &delta, 8);
+            }
+            memcpy(x_column + k * sizeof(uint16_t), record + sizeof(uint64_t), sizeof(uint16_t));
+            memcpy(y_column + k * sizeof(uint16_t), record + sizeof(uint64_t) + sizeof(uint16_t), sizeof(uint16_t));
+        }
+
+        fwrite(padding, 1, (size_t)(block->offset - position), output);
+        fwrite(column, 1, columnar_block_bytes(block), output);
+        position = (long)(block->offset + columnar_block_bytes(block));
+    }
+
+    printf("%u events in %u blocks of %u (%s): %.2f bytes/event (raw: %d)\n", count, header.nb_blocks,
+           block_events, (header.flags & COLUMNAR_FLAG_SORTED) ? "sorted" : "unsorted",
+           count > 0 ? (double)position / count : 0.0, EVENT_SIZE_BYTES);
+
+    free(column);
+    free(blocks);
+    return 0;
+}
+
+int columnar_to_raw(const unsigned char *data, size_t size, FILE *output) {
+    ColumnarHeader header;
+    if (size < sizeof(header)) {
+        printf("Error: File too small for a columnar header\n");
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, COLUMNAR_MAGIC, 4) != 0 || header.version != COLUMNAR_VERSION ||
+        header.total_events > UINT32_MAX ||
+        sizeof(header) + (uint64_t)header.nb_blocks * sizeof(ColumnarBlock) > size) {
+        printf("Error: Not a columnar event file\n");
+        return 1;
+    }
+
+    uint32_t count = (uint32_t)header.total_events;
+    fwrite(&count, sizeof(count), 1, output);
+
+    for (uint32_t b = 0; b < header.nb_blocks; b++) {
+        ColumnarBlock block;
+        memcpy(&block, data + sizeof(header) + (size_t)b * sizeof(block), sizeof(block));
+        if ((block.ts_bytes != 2 && block.ts_bytes != 4 && block.ts_bytes != 8) ||
+            block.offset + columnar_block_bytes(&block) > size) {
+            printf("Error: Corrupted block %u\n", b);
+            return 1;
+        }
+
+        const unsigned char *column = data + block.offset;
+        const unsigned char *x_column = column + (size_t)block.count * block.ts_bytes;
+        const unsigned char *y_column = x_column + (size_t)block.count * sizeof(uint16_t);
+        for (uint32_t k = 0; k < block.count; k++) {
+            unsigned char record[EVENT_SIZE_BYTES];
+            uint64_t delta = 0;
+            memcpy(&delta, column + (size_t)k * block.ts_bytes, block.ts_bytes);  // Little endian
+            uint64_t timestamp = block.base_timestamp + delta;
+            memcpy(record, &timestamp, sizeof(uint64_t));
+            memcpy(record + sizeof(uint64_t), x_column + k * sizeof(uint16_t), sizeof(uint16_t));
+            memcpy(record + sizeof(uint64_t) + sizeof(uint16_t), y_column + k * sizeof(uint16_t), sizeof(uint16_t));
+            fwrite(record, 1, EVENT_SIZE_BYTES, output);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Usage: %s [--to-raw] [--block-events N] <input> <output>\n";
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    uint32_t block_events = COLUMNAR_DEFAULT_BLOCK_EVENTS;
+    int to_raw = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--to-raw") == 0) {
+            to_raw = 1;
+        } else if (strcmp(argv[i], "--block-events") == 0 && i + 1 < argc) {
+            block_events = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (block_events == 0) {
+                printf("Error: --block-events must be positive\n");
+                return 1;
+            }
+        } else if (input_path == NULL) {
+            input_path = argv[i];
+        } else if (output_path == NULL) {
+            output_path = argv[i];
+        } else {
+            printf(usage, argv[0]);
+            return 1;
+        }
+    }
+    if (input_path == NULL || output_path == NULL) {
+        printf(usage, argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    unsigned char *data = load_file(input_path, &size);
+    if (data == NULL) {
+        return 1;
+    }
+    if (!to_raw && size < sizeof(uint32_t)) {
+        printf("Error: File too small for a raw header\n");
+        free(data);
+        return 1;
+    }
+
+    FILE *output = fopen(output_path, "wb");
+    if (!output) {
+        printf("Error: Could not create output file %s\n", output_path);
+        free(data);
+        return 1;
+    }
+
+    int rc = to_raw ? columnar_to_raw(data, size, output) : raw_to_columnar(data, size, block_events, output);
+
+    fclose(output);
+    free(data);
+    return rc;
+}
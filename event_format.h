@@ -0,0 +1,81 @@
+#ifndef EVENT_FORMAT_H
+#define EVENT_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * Columnar event file (EVC1), shared by the processing program and evc_convert.
+ *
+ *   ColumnarHeader
+ *   ColumnarBlock[nb_blocks]            block index
+ *   block 0, block 1, ...               each starting on an 8-byte boundary
+ *
+ * A block holds `count` events as three columns:
+ *   count * ts_bytes   timestamp - base_timestamp (uint16, uint32 or uint64)
+ *   count * 2          x (uint16)
+ *   count * 2          y (uint16)
+ *
+ * Every block but the last holds exactly block_events events, so event i lives in
+ * block i / block_events. All fields are little endian.
+ */
+
+#define COLUMNAR_MAGIC "EVC1"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_FLAG_SORTED 1  // Timestamps are non-decreasing over the whole file
+#define COLUMNAR_DEFAULT_BLOCK_EVENTS 4096
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t total_events;
+    uint64_t first_timestamp;  // Timestamp of event 0 (the origin of the histogram bins)
+    uint32_t block_events;
+    uint32_t nb_blocks;
+    uint32_t flags;
+    uint32_t reserved;
+} ColumnarHeader;
+
+typedef struct {
+    uint64_t offset;           // Byte offset of the block in the file
+    uint64_t base_timestamp;   // Smallest timestamp of the block
+    uint32_t count;
+    uint32_t ts_bytes;         // Width of a timestamp delta: 2, 4 or 8
+} ColumnarBlock;
+
+// Bytes taken by a block's three columns (without the alignment padding)
+static inline uint64_t columnar_block_bytes(const ColumnarBlock *block) {
+    return (uint64_t)block->count * (block->ts_bytes + 2 * sizeof(uint16_t));
+}
+
+/*
+ * Sidecar time index (<recording>.idx), written next to a timestamp-sorted recording of
+ * either format:
+ *
+ *   TimeIndexHeader
+ *   uint64_t bin_starts[nb_bins + 1]    index of the first event with
+ *                                       (timestamp - first timestamp) / bin_us >= bin
+ *
+ * Events [bin_starts[a], bin_starts[b]) are exactly those of bins [a, b). The size and
+ * modification time of the recording are kept so that a stale index is ignored. A recording
+ * found not to be sorted gets a header flagged TIME_INDEX_FLAG_UNSORTED and no bin_starts,
+ * so that it is not scanned again on every run.
+ */
+
+#define TIME_INDEX_MAGIC "EVI1"
+#define TIME_INDEX_VERSION 1
+#define TIME_INDEX_SUFFIX ".idx"
+#define TIME_INDEX_FLAG_UNSORTED 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t total_events;
+    uint32_t nb_bins;
+    uint32_t bin_us;           // Bin width in timestamp units (microseconds)
+    uint32_t flags;
+    uint32_t reserved;
+} TimeIndexHeader;
+
+#endif // EVENT_FORMAT_H
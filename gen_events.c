@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+// Generates synthetic recordings in the raw input format (4-byte count + 12-byte records of
+// timestamp, x, y) for local benchmarks. Events are timestamp-sorted over the recording (2 s of
+// a 640x480 sensor by default); a share of them is clustered around spatial hotspots and a share
+// falls into short bursts.
+
+#define EVENT_SIZE_BYTES 12
+#define BURST_US 20000             // Length of one burst
+#define HOTSPOT_SIGMA 12.0         // Spread of a hotspot in pixels
+#define FIRST_TIMESTAMP 1700000000000000ULL
+
+typedef struct {
+    const char *folder;
+    const char *prefix;
+    int width;
+    int height;
+    uint64_t duration_us;
+    long events;         // Per file
+    int files;
+    int hotspots;
+    double hot_share;    // Share of events drawn around a hotspot
+    int bursts;
+    double burst_share;  // Share of events falling into a burst
+    uint64_t seed;
+} GenOptions;
+
+// xorshift64*: fast, and the same stream on every platform for a given seed
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_uniform(void) {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_normal(void) {
+    double u = rng_uniform();
+    double v = rng_uniform();
+    return sqrt(-2.0 * log(u > 0 ? u : 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t ua = *(const uint64_t *)a;
+    uint64_t ub = *(const uint64_t *)b;
+    return (ua > ub) - (ua < ub);
+}
+
+static unsigned short clamp_coord(double v, int limit) {
+    if (v < 0) {
+        return 0;
+    }
+    if (v >= limit) {
+        return (unsigned short)(limit - 1);
+    }
+    return (unsigned short)v;
+}
+
+int generate_file(const GenOptions *g, int file, uint64_t *timestamps, unsigned char *records) {
+    double hot_x[64], hot_y[64];
+    uint64_t burst_start[64];
+
+    for (int h = 0; h < g->hotspots; h++) {
+        hot_x[h] = rng_uniform() * g->width;
+        hot_y[h] = rng_uniform() * g->height;
+    }
+    for (int b = 0; b < g->bursts; b++) {
+        burst_start[b] = (uint64_t)(rng_uniform() * (g->duration_us - BURST_US));
+    }
+
+    // Timestamps: uniform over the recording, or inside one of the bursts; then sorted
+    for (long e = 0; e < g->events; e++) {
+        if (g->bursts > 0 && rng_uniform() < g->burst_share) {
+            timestamps[e] = burst_start[rng_next() % g->bursts] + (uint64_t)(rng_uniform() * BURST_US);
+        } else {
+            timestamps[e] = (uint64_t)(rng_uniform() * g->duration_us);
+        }
+    }
+    qsort(timestamps, g->events, sizeof(uint64_t), compare_u64);
+
+    for (long e = 0; e < g->events; e++) {
+        unsigned char *record = records + e * EVENT_SIZE_BYTES;
+        uint64_t timestamp = FIRST_TIMESTAMP + timestamps[e];
+        unsigned short x, y;
+
+        if (g->hotspots > 0 && rng_uniform() < g->hot_share) {
+            int h = (int)(rng_next() % g->hotspots);
+            x = clamp_coord(hot_x[h] + rng_normal() * HOTSPOT_SIGMA, g->width);
+            y = clamp_coord(hot_y[h] + rng_normal() * HOTSPOT_SIGMA, g->height);
+        } else {
+            x = (unsigned short)(rng_next() % g->width);
+            y = (unsigned short)(rng_next() % g->height);
+        }
+
+        memcpy(record, &timestamp, sizeof(uint64_t));
+        memcpy(record + sizeof(uint64_t), &x, sizeof(unsigned short));
+        memcpy(record + sizeof(uint64_t) + sizeof(unsigned short), &y, sizeof(unsigned short));
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s_%03d.bin", g->folder, g->prefix, file);
+    FILE *output = fopen(path, "wb");
+    if (!output) {
+        printf("Error: Could not create output file %s\n", path);
+        return 1;
+    }
+    unsigned int count = (unsigned int)g->events;
+    fwrite(&count, sizeof(unsigned int), 1, output);
+    fwrite(records, EVENT_SIZE_BYTES, g->events, output);
+    fclose(output);
+    printf("Data saved to %s\n", path);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    GenOptions g = {"bench_events", "synth", 640, 480, 2000000, 1000000, 4, 8, 0.5, 10, 0.3, 1};
+    const char *usage = "Usage: %s [--folder dir] [--prefix name] [--sensor WxH] [--duration ms] [--events N] "
+                        "[--files K] [--hotspots H] [--hot-share f] [--bursts B] [--burst-share f] [--seed S]\n";
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf(usage, argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--folder") == 0) {
+            g.folder = argv[++i];
+        } else if (strcmp(argv[i], "--prefix") == 0) {
+            g.prefix = argv[++i];
+        } else if (strcmp(argv[i], "--sensor") == 0) {
+            if (sscanf(argv[++i], "%dx%d", &g.width, &g.height) != 2) {
+                printf(usage, argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--duration") == 0) {
+            g.duration_us = strtoull(argv[++i], NULL, 10) * 1000;
+        } else if (strcmp(argv[i], "--events") == 0) {
+            g.events = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--files") == 0) {
+            g.files = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hotspots") == 0) {
+            g.hotspots = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hot-share") == 0) {
+            g.hot_share = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--bursts") == 0) {
+            g.bursts = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--burst-share") == 0) {
+            g.burst_share = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            g.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            printf(usage, argv[0]);
+            return 1;
+        }
+    }
+
+    if (g.events < 0 || g.events > UINT32_MAX || g.files < 1 ||
+        g.hotspots < 0 || g.hotspots > 64 || g.bursts < 0 || g.bursts > 64 ||
+        g.width < 1 || g.width > 65536 || g.height < 1 || g.height > 65536 || g.duration_us <= BURST_US) {
+        printf("Error: Invalid arguments (events <= %u, files >= 1, at most 64 hotspots and bursts, "
+               "sides of at most 65536, duration over %d ms).\n", UINT32_MAX, BURST_US / 1000);
+        return 1;
+    }
+
+    mkdir(g.folder, 0755);
+    rng_state = g.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    uint64_t *timestamps = malloc((g.events > 0 ? g.events : 1) * sizeof(uint64_t));
+    unsigned char *records = malloc((g.events > 0 ? g.events : 1) * EVENT_SIZE_BYTES);
+    if (timestamps == NULL || records == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int rc = 0;
+    for (int f = 0; f < g.files && rc == 0; f++) {
+        rc = generate_file(&g, f, timestamps, records);
+    }
+
+    free(timestamps);
+    free(records);
+    return rc;
+}
@@ -1,114 +1,3579 @@
+#define _GNU_SOURCE  // sched_setaffinity and CPU_* for thread pinning
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>  // SCNu64 for the manifest sizes
 #include <string.h>
 #include <unistd.h>
 #include <omp.h>  // Include OpenMP header
+#include <pthread.h>  // I/O threads of the pipelined mode
 #include <time.h>
 #include <sys/time.h>  // For gettimeofday
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>  // For mmap/madvise
+#include <sys/resource.h>  // For getrusage (peak memory)
+#include <sched.h>  // Thread pinning
+#include <sys/syscall.h>  // set_mempolicy without libnuma
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/inotify.h>  // --watch
+#include <poll.h>
+#include <signal.h>
+#include <limits.h>
+#include <errno.h>
 #include "mpi.h"
+#include "event_format.h"
 
-#define WIDTH 640
-#define HEIGHT 480
-#define MILLIS 2000  // Number of milliseconds for the output array
+#define DEFAULT_WIDTH 640
+#define DEFAULT_HEIGHT 480
+#define DEFAULT_DURATION_MS 2000  // Length of the recordings covered by the histogram
+#define DEFAULT_BIN_US 1000  // Histogram bin width in timestamp units (1 ms)
+#define MAX_PIXELS (1 << 28)  // Largest --sensor (pixel indices and MPI counts stay in an int)
+#define MAX_BINS (1 << 26)
+#define MAX_HIST_LEVELS 8  // Coarser histograms of --hist-levels
+#define DEFAULT_FRAME_MEMORY_MB 256  // Bound of the --frames stack of a rank
 #define EVENT_SIZE_BYTES 12  // Each event is 96 bits = 12 bytes
-#define MAX_FILENAME_LENGTH 256
-#define MAX_FOLDER_LENGTH 32
-#define MAX_FILES 1000  // Max Expected Nbr of Files
+#define MAX_FILENAME_LENGTH 4096  // Longest path of an input or output file
+#define EVENT_BATCH 4096  // Events decoded per batch (and routed per round by the owner heatmap accumulation)
+#define PREFETCH_BLOCK_BYTES (1 << 20)  // Read size used to warm the page cache for the fread reader
+#define REDUCE_TILE 2048  // Counters per reduction tile (8 KB, stays in L1 across all partials)
+#define REDUCE_PARALLEL_MIN (1 << 16)  // Below this many counters in total the reduction stays serial
+#define HEAT_TILE_SHIFT 12  // Partition heatmaps: a tile is 4096 consecutive counters (16 KB, fits L1)
+#define MAX_HEAT_TILES 1024  // Larger sensors get wider tiles, so that a batch's counting sort stays cheap
+#define MAX_NUMA_NODES 64  // Nodes tracked in the 64-bit node mask
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0  // Memory policies of set_mempolicy(2) (numaif.h is not always installed)
+#define MPOL_INTERLEAVE 3
+#endif
+#define TRACE_MAX_SPANS (1 << 16)  // Spans kept per rank by --trace; later ones are dropped
+#define TRACE_TID_WRITER 1000  // Trace lanes of the --pipeline I/O threads
+#define TRACE_TID_PREFETCHER 1001
+#define WATCH_POLL_MS 200  // --watch: rank 0 checks for a stop request at least this often
+#define WATCH_IDLE_SLEEP_US 1000  // --watch: the other ranks poll for the next batch this often
 
-// Structure to store file names and count
+// Sensor geometry and histogram binning (--sensor, --duration, --bin-us), identical on every rank
+// and set before any buffer is sized
 typedef struct {
-    char file_names[MAX_FILES][MAX_FILENAME_LENGTH];
-    char folder_name[MAX_FOLDER_LENGTH];
+    int width;
+    int height;
+    int millis;       // Number of histogram bins
+    uint64_t bin_us;  // Bin width in timestamp units
+} Geometry;
+
+static Geometry geometry = {DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_DURATION_MS * 1000 / DEFAULT_BIN_US, DEFAULT_BIN_US};
+
+#define WIDTH (geometry.width)
+#define HEIGHT (geometry.height)
+#define MILLIS (geometry.millis)
+#define BIN_US (geometry.bin_us)
+
+// Manifest of the input recordings (identical on every rank once broadcast)
+typedef struct {
+    char *folder_name;
     int nb_files;
+    int capacity;
+    char *names;                 // Every file name, NUL terminated, back to back
+    size_t names_bytes;
+    size_t names_capacity;
+    size_t *name_offsets;        // Start of each file's name in names
+    uint64_t *file_sizes;        // Bytes of each file
+    unsigned int *total_events;  // Event count from each file header
 } FileList;
 
-int parse_arguments(int argc, char *argv[], const char **folder_path) {
-    if (argc < 2) {
-        printf("Usage: %s --folder <folder_path>\n", argv[0]);
+// How the events of an input file are brought into memory
+typedef enum {
+    READER_MMAP,   // Map the file once per rank, threads decode straight from the mapping
+    READER_FREAD   // Each thread opens the file and freads its chunk in batches
+} ReaderMode;
+
+// How files are handed out to MPI ranks
+typedef enum {
+    SCHEDULE_STATIC,   // File i goes to rank i % num_tasks
+    SCHEDULE_DYNAMIC,  // Ranks claim the next file (largest first) from a counter held by rank 0
+    SCHEDULE_SPLIT     // Every file is carved into (rank, thread) chunks and reduced to an owner rank
+} ScheduleMode;
+
+// Per-rank file dispenser for the chosen schedule
+typedef struct {
+    ScheduleMode mode;
+    int nb_files;
+    int *file_idxs;          // Static: files owned by this rank
+    int num_files_for_rank;
+    int next;                // Static: cursor into file_idxs
+    MPI_Win win;             // Dynamic: window exposing the shared counter on rank 0
+    int *counter;
+    double wait_time;        // Time spent waiting for the next file index
+} FileScheduler;
+
+// Read-only view of an input file, shared by all threads of a rank
+typedef struct {
+    int fd;
+    const unsigned char *data;
+    size_t size;
+} MappedFile;
+
+// On-disk layout of an input file, detected from its header
+typedef enum {
+    FORMAT_RAW,       // 4-byte count followed by 12-byte (timestamp, x, y) records
+    FORMAT_COLUMNAR   // EVC1 blocks of delta-coded timestamps and x/y columns (event_format.h)
+} EventFormat;
+
+// An opened input file of either format
+typedef struct {
+    EventFormat format;
+    MappedFile mapped;        // Whole file (mmap reader only)
+    size_t file_size;
+    unsigned int total_events;
+    uint64_t first_timestamp;
+    uint32_t block_events;    // Columnar only
+    uint32_t nb_blocks;
+    uint32_t flags;
+    ColumnarBlock *blocks;    // Columnar only: copy of the block index
+} EventFile;
+
+// Decoded events in structure-of-arrays form, whatever the input format
+typedef struct {
+    long count;
+    uint64_t t_offset[EVENT_BATCH];  // Timestamp - first timestamp of the file
+    unsigned short x[EVENT_BATCH];
+    unsigned short y[EVENT_BATCH];
+} EventBatch;
+
+// A thread's position within its range of events
+typedef struct {
+    const EventFile *ef;
+    long next;                // Next event to decode
+    long end;                 // One past the last event of this thread
+    FILE *file;               // fread reader only
+    unsigned char *buffer;    // fread reader: a batch of raw records or one columnar block
+    long buffered_block;      // Columnar block currently held in buffer (-1 if none)
+} EventCursor;
+
+// How the threads of a rank build a heatmap
+typedef enum {
+    HEAT_ACCUM_PRIVATE,  // One full WIDTH x HEIGHT copy per thread, summed after the parallel region
+    HEAT_ACCUM_ATOMIC,   // A single shared copy updated with atomic increments
+    HEAT_ACCUM_OWNER,    // A single shared copy; each thread owns a band of x and events are routed to it
+    HEAT_ACCUM_PARTITION // Private copies as above, each batch sorted by tile before it is added
+} HeatAccumMode;
+
+// How the per-thread partials are combined on the CPU (without OFFLOADGPU)
+typedef enum {
+    REDUCE_TILED,  // Every tile of counters sums all partials in one sweep
+    REDUCE_TREE    // Pairwise in-place sums over log2(num_threads) levels
+} ReduceMode;
+
+// Kind of heatmap update done by accumulate_batch()
+#define HEAT_UPDATE_NONE 0
+#define HEAT_UPDATE_PLAIN 1
+#define HEAT_UPDATE_ATOMIC 2
+
+// Rows [lo, hi) of a counter array written since it was last zeroed (empty when lo >= hi)
+typedef struct {
+    int lo;
+    int hi;
+} DirtyRange;
+
+// Events a file could not count: past the last histogram bin, or outside the sensor
+typedef struct {
+    long late;
+    long outside;
+} OutOfRange;
+
+// Outputs of one input file (partial sums until reduced when the file is split across ranks)
+typedef struct FileResult {
+    unsigned int *occurrences;               // MILLIS counters
+    unsigned int *data_block_2d;             // WIDTH * HEIGHT counters, x-major
+    DirtyRange heat_dirty;                   // x columns of data_block_2d that are not zero
+    char hist_filename[MAX_FILENAME_LENGTH];
+    char heat_filename[MAX_FILENAME_LENGTH];
+    int compress_heatmap;                    // Write heat_filename as a .hmz (--heat-format auto)
+    int owner;                               // Rank that writes the outputs
+    int file_idx;
+    MPI_Request requests[2];                 // In-flight reductions towards the owner
+    int nb_requests;
+    struct FileResult *next_free;            // Link in the pool of released results
+} FileResult;
+
+// Per-thread partials and scratch buffers of accumulate_events(), allocated on first use and kept
+// from one file to the next. A partial is only zeroed where the previous file wrote it.
+typedef struct {
+    int num_threads;
+    unsigned int *occurrences_private;  // num_threads * MILLIS
+    unsigned int *data_block_3d;        // num_threads * WIDTH * HEIGHT, page aligned
+    unsigned int ***heatmap_3d;         // [thread][x] pointers into data_block_3d
+    DirtyRange *hist_dirty;             // Per thread: bins of its histogram partial
+    DirtyRange *heat_dirty;             // Per thread: x columns of its heatmap partial
+    EventBatch **batches;               // Per thread decode buffer
+    unsigned int **pixels;              // Per thread routing scratch (owner and partition heatmaps)
+    unsigned int **tile_bufs;           // Per thread pixel indices sorted by tile (partition heatmaps)
+    int *x_owner;
+    unsigned int *route_bufs;
+    int *route_offsets;
+    unsigned int *frame_stack;          // --frames: the frames of the current window
+    unsigned int *frame_partials;       // --frames: per thread copies of the window, when they fit
+} Accumulators;
+
+// --frames: the heatmap frames [first, first + count) accumulated in the current pass, each covering
+// frame_us of the recording. With partials, every thread fills its own copy of the window and the
+// copies are summed into stack after the pass; otherwise the threads update stack atomically.
+typedef struct {
+    unsigned int *stack;
+    int first;
+    int count;
+    uint64_t frame_us;
+    unsigned int *partials;  // [thread][frame][x][y], NULL for the shared stack
+} FrameWindow;
+
+static Accumulators accumulators;  // Alive for the whole run (and across batches of --watch)
+
+// Dataset-wide outputs (--aggregate)
+typedef enum {
+    AGGREGATE_NONE,
+    AGGREGATE_ALL,     // One histogram/heatmap over every file
+    AGGREGATE_SCENES   // Also one per scene (file name prefix)
+} AggregateMode;
+
+// Encoding of the per-file heatmaps
+typedef enum {
+    HEAT_FORMAT_DENSE,  // map_<base>.bin: WIDTH * HEIGHT uint32
+    HEAT_FORMAT_AUTO    // map_<base>.hmz: smallest encoding for the file's density
+} HeatFormat;
+
+/*
+ * Compressed heatmap (map_<base>.hmz), encoded per file in the smallest of four layouts:
+ *
+ *   HeatmapHeader
+ *   HEATMAP_SPARSE:   uint32 index[nb_entries], then uint32 count[nb_entries] of every non-zero
+ *                     pixel, in increasing index = x * height + y
+ *   HEATMAP_DENSE8:   uint8 count[width * height] saturated at 255, then the pixels above it
+ *                     as uint32 index[nb_entries] and uint32 count[nb_entries]
+ *   HEATMAP_DENSE16:  the same with uint16 counts saturated at 65535
+ *   HEATMAP_DENSE32:  uint32 count[width * height], as in map_<base>.bin
+ *
+ * All fields are little endian.
+ */
+#define HEATMAP_MAGIC "HMZ1"
+#define HEATMAP_VERSION 1
+
+typedef enum {
+    HEATMAP_SPARSE,
+    HEATMAP_DENSE8,
+    HEATMAP_DENSE16,
+    HEATMAP_DENSE32
+} HeatmapEncoding;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t encoding;
+    uint32_t reserved;
+    uint64_t nb_entries;       // Sparse pixels, or DENSE8/DENSE16 overflows
+} HeatmapHeader;
+
+static const char *heatmap_encoding_names[] = {"sparse", "dense8", "dense16", "dense32"};
+
+// Running totals of the results a rank owns, in groups of group_size counters (the histogram,
+// then the heatmap): group 0 covers every file, the others one scene each
+typedef struct {
+    int nb_groups;
+    char **group_names;       // "all", then the scene names
+    size_t group_size;
+    int *file_group;          // Scene group of every file of the manifest (0 without scenes)
+    unsigned int *totals;     // nb_groups * group_size
+    unsigned int *reduced;    // Rank 0: every rank's totals summed
+    MPI_Request request;
+} Aggregate;
+
+static Aggregate aggregate;
+
+/*
+ * Result container (--container): every output of a run in one file, written with collective MPI-IO.
+ *
+ *   ContainerHeader                       at offset 0
+ *   record[nb_files]                      record i (file i of the manifest) at data_offset + i * record_bytes:
+ *                                         histogram (millis uint32, if bit 0 of outputs), then
+ *                                         heatmap (width * height uint32, x-major, if bit 1)
+ *   ContainerEntry[nb_files]              at index_offset, then the base names, each NUL terminated
+ *
+ * All fields are little endian. The index is rewritten after the last record whenever files are added.
+ */
+#define CONTAINER_MAGIC "EVR1"
+#define CONTAINER_VERSION 1
+#define CONTAINER_DATA_OFFSET 64
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t nb_files;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    uint64_t record_bytes;
+    uint32_t millis;
+    uint32_t width;
+    uint32_t height;
+    uint32_t outputs;          // Bit 0: histograms, bit 1: heatmaps
+    uint32_t reserved[2];
+} ContainerHeader;
+
+typedef struct {
+    uint64_t record_offset;
+    uint32_t name_offset;      // From the end of the entries
+    uint32_t name_length;      // Without the NUL
+} ContainerEntry;
+
+typedef struct {
+    MPI_File fh;
+    size_t hist_bytes;         // Per record
+    size_t heat_bytes;
+    FileResult *staged;        // Owned results finished since the last round, linked by next_free
+    int nb_staged;
+} Container;
+
+static Container container;
+
+// Next input file being opened and pulled into memory by a background thread (--pipeline)
+typedef struct {
+    pthread_t thread;
+    int active;
+    char input_filename[MAX_FILENAME_LENGTH];
+    int file_idx;
+    ReaderMode reader;
+    EventFile ef;
+    int status;
+} Prefetcher;
+
+// Output write running in a background thread (--pipeline); at most one is in flight
+typedef struct {
+    pthread_t thread;
+    int active;
+    FileResult *result;
+    const struct Options *opts;
+    int status;
+} Writer;
+
+// Where the page cache pages of the input files are placed
+typedef enum {
+    NUMA_INPUT_LOCAL,      // Next to the thread that first reads them (each thread reads its own chunk)
+    NUMA_INPUT_INTERLEAVE  // Spread over all nodes of the rank when the file is opened
+} NumaInput;
+
+// NUMA layout of the CPUs this rank may run on
+typedef struct {
+    int nb_nodes;
+    int nb_cpus;
+    int *cpus;                // Allowed CPUs, node by node
+    int *cpu_node;            // Node of cpus[i]
+    unsigned long node_mask;  // Nodes holding allowed CPUs
+    int pinned;               // OpenMP thread t runs on cpus[t % nb_cpus]
+    int interleave_input;     // Input pages are interleaved over the nodes
+} NumaTopology;
+
+static NumaTopology numa;  // Shared with the prefetcher thread
+
+// Ranks sharing a node's memory (--shm). Files go to nodes rather than to ranks. The ranks of a
+// node split every file between them, accumulate into their own slot of a shared window and sum
+// the slots into the node's first one, which the node leader turns into the outputs.
+typedef struct {
+    int enabled;
+    MPI_Comm node_comm;    // Ranks of this node
+    MPI_Comm leader_comm;  // First rank of every node (MPI_COMM_NULL on the other ranks)
+    int node_rank;
+    int node_size;
+    int node_index;        // This node among all nodes (rank of its leader in leader_comm)
+    int nb_nodes;
+    int *leader_ranks;     // World rank of the leader of every node
+    MPI_Win win;
+    unsigned int **slots;  // Per node rank: MILLIS histogram counters, then WIDTH * HEIGHT heatmap counters
+    DirtyRange slot_dirty; // x columns of this rank's slot heatmap that are not zero
+} NodeShm;
+
+static NodeShm shm;
+
+// Phases of the file loop, timed on every rank and reported with their throughput at the end
+typedef enum {
+    PHASE_OPEN,     // Opening the file, reading its header and locating the time window
+    PHASE_DECODE,   // Parallel decode and accumulate
+    PHASE_REDUCE,   // Combining the per-thread partials
+    PHASE_OUTPUT,   // Reduction across ranks and writing the outputs
+    NB_PHASES
+} Phase;
+
+static const char *phase_names[NB_PHASES] = {"open", "decode", "reduce", "output"};
+
+// Counters of the file loop of a rank, added up over every call of process_files()
+typedef struct {
+    unsigned long long events;  // Events decoded by this rank (for the reader throughput)
+    double read_time;           // Time spent in the parallel decode/accumulate regions
+    double bytes;               // Input bytes covered by those events
+    double phase_time[NB_PHASES];
+    double wait_time;           // Time spent waiting for file indices
+    OutOfRange dropped;         // Events left out of the histograms / heatmaps
+} RankStats;
+
+// One timed span of --trace (plain data, gathered to rank 0 as bytes)
+typedef struct {
+    char name[16];
+    int tid;            // OpenMP thread, or TRACE_TID_WRITER / TRACE_TID_PREFETCHER
+    int file_idx;       // -1 if not tied to a file
+    double start;       // Seconds since the rank's start
+    double duration;
+    double events;
+    double bytes;
+    double imbalance;   // Slowest / mean thread time of a parallel region (0 if not applicable)
+} TraceSpan;
+
+typedef struct {
+    int enabled;
+    double origin;
+    int file_idx;       // File being processed by the main thread
+    TraceSpan *spans;
+    int nb_spans;
+} Trace;
+
+static Trace trace;             // Spans of every thread of this rank
+static __thread int trace_tid;  // Lane of the calling non-OpenMP thread (0 for the main thread)
+
+// Run-time options (identical on every rank)
+typedef struct Options {
+    const char *folder_path;
+    ReaderMode reader;
+    ScheduleMode schedule;
+    int pipeline;    // Prefetch file N+1 and write file N-1 while file N is accumulated
+    HeatAccumMode heat_accum;
+    ReduceMode reduce;
+    int histograms;  // Produce histograms/occ_*.bin
+    int heatmaps;    // Produce heatmaps/map_*.bin
+    HeatFormat heat_format;
+    Geometry geometry;
+    int t_start;     // Only events of the bins [t_start, t_end) are accumulated
+    int t_end;
+    int build_index; // Write missing or stale <recording>.idx time indexes
+    const char *trace_path;  // Chrome trace JSON written by rank 0 (NULL: no tracing)
+    const char *manifest_path;  // List of recordings to use instead of scanning the folder
+    int pin;         // Pin OpenMP threads to CPUs node by node
+    NumaInput numa_input;
+    int watch;       // Keep running and process the recordings that land in the folder
+    int shm;         // Ranks of a node share every file and reduce through shared memory
+    AggregateMode aggregate;
+    const char *container_path;  // Single output file written with MPI-IO (NULL: one file per output)
+    int hist_levels[MAX_HIST_LEVELS];  // Coarser histograms, in base bins per bin
+    int nb_hist_levels;
+    int frame_bins;  // Length of a heatmap frame in bins (0: no frames)
+    long frame_memory_mb;
+} Options;
+
+// Parse a comma separated list such as "hist,heat" into the output flags
+int parse_outputs(const char *list, Options *opts) {
+    char buffer[64];
+    strncpy(buffer, list, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    opts->histograms = 0;
+    opts->heatmaps = 0;
+    for (char *item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (strcmp(item, "hist") == 0) {
+            opts->histograms = 1;
+        } else if (strcmp(item, "heat") == 0) {
+            opts->heatmaps = 1;
+        } else {
+            return 1;
+        }
+    }
+    return (opts->histograms || opts->heatmaps) ? 0 : 1;
+}
+
+int parse_arguments(int argc, char *argv[], Options *opts, int verbose) {
+    opts->folder_path = NULL;
+    opts->reader = READER_MMAP;
+    opts->schedule = SCHEDULE_STATIC;
+    opts->pipeline = 0;
+    opts->heat_accum = HEAT_ACCUM_PRIVATE;
+    opts->reduce = REDUCE_TILED;
+    opts->geometry = (Geometry){DEFAULT_WIDTH, DEFAULT_HEIGHT, 0, DEFAULT_BIN_US};
+    long duration_ms = DEFAULT_DURATION_MS;
+    opts->t_start = 0;
+    opts->t_end = -1;  // Up to the last bin
+    opts->build_index = 0;
+    opts->trace_path = NULL;
+    opts->manifest_path = NULL;
+    opts->pin = 0;
+    opts->numa_input = NUMA_INPUT_LOCAL;
+    opts->watch = 0;
+    opts->shm = 0;
+    opts->aggregate = AGGREGATE_NONE;
+    opts->container_path = NULL;
+    opts->heat_format = HEAT_FORMAT_DENSE;
+    opts->nb_hist_levels = 0;
+    opts->frame_bins = 0;
+    opts->frame_memory_mb = DEFAULT_FRAME_MEMORY_MB;
+
+    // The build flavour picks the default outputs; a build without -DHISTOGRAMS/-DHEATMAPS does both
+    #if defined(HISTOGRAMS) || defined(HEATMAPS)
+        opts->histograms = 0;
+        opts->heatmaps = 0;
+        #ifdef HISTOGRAMS
+            opts->histograms = 1;
+        #endif
+        #ifdef HEATMAPS
+            opts->heatmaps = 1;
+        #endif
+    #else
+        opts->histograms = 1;
+        opts->heatmaps = 1;
+    #endif
+
+    if (argc < 2) {
+        if (verbose) printf("Usage: %s --folder <folder_path> [--manifest <file>] [--reader mmap|fread] [--outputs hist,heat] [--schedule static|dynamic|split] [--pipeline] [--heat-accum private|atomic|owner|partition] [--reduce tiled|tree] [--t-start bin] [--t-end bin] [--index] [--trace <file>] [--pin] [--numa-input local|interleave] [--watch] [--shm] [--aggregate all|scenes] [--container <file>] [--heat-format dense|auto] [--sensor WxH] [--duration ms] [--bin-us us] [--hist-levels f1,f2,...] [--frames bins] [--frame-memory MB]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--folder") == 0 && i + 1 < argc) {
+            opts->folder_path = argv[++i];
+        } else if (strcmp(argv[i], "--reader") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "mmap") == 0) {
+                opts->reader = READER_MMAP;
+            } else if (strcmp(argv[i], "fread") == 0) {
+                opts->reader = READER_FREAD;
+            } else {
+                if (verbose) printf("Error: Unknown reader '%s' (expected mmap or fread).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "static") == 0) {
+                opts->schedule = SCHEDULE_STATIC;
+            } else if (strcmp(argv[i], "dynamic") == 0) {
+                opts->schedule = SCHEDULE_DYNAMIC;
+            } else if (strcmp(argv[i], "split") == 0) {
+                opts->schedule = SCHEDULE_SPLIT;
+            } else {
+                if (verbose) printf("Error: Unknown schedule '%s' (expected static, dynamic or split).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--heat-accum") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "private") == 0) {
+                opts->heat_accum = HEAT_ACCUM_PRIVATE;
+            } else if (strcmp(argv[i], "atomic") == 0) {
+                opts->heat_accum = HEAT_ACCUM_ATOMIC;
+            } else if (strcmp(argv[i], "owner") == 0) {
+                opts->heat_accum = HEAT_ACCUM_OWNER;
+            } else if (strcmp(argv[i], "partition") == 0) {
+                opts->heat_accum = HEAT_ACCUM_PARTITION;
+            } else {
+                if (verbose) printf("Error: Unknown heatmap accumulation '%s' (expected private, atomic, owner or partition).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--reduce") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "tiled") == 0) {
+                opts->reduce = REDUCE_TILED;
+            } else if (strcmp(argv[i], "tree") == 0) {
+                opts->reduce = REDUCE_TREE;
+            } else {
+                if (verbose) printf("Error: Unknown reduction '%s' (expected tiled or tree).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--t-start") == 0 && i + 1 < argc) {
+            opts->t_start = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--t-end") == 0 && i + 1 < argc) {
+            opts->t_end = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sensor") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &opts->geometry.width, &opts->geometry.height) != 2) {
+                if (verbose) printf("Error: Invalid sensor size '%s' (expected WIDTHxHEIGHT).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--bin-us") == 0 && i + 1 < argc) {
+            opts->geometry.bin_us = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hist-levels") == 0 && i + 1 < argc) {
+            char *item = argv[++i];
+            opts->nb_hist_levels = 0;
+            while (*item != '\0' && opts->nb_hist_levels < MAX_HIST_LEVELS) {
+                char *end;
+                long factor = strtol(item, &end, 10);
+                if (end == item || factor < 2 || factor > MAX_BINS || (*end != ',' && *end != '\0')) {
+                    if (verbose) printf("Error: Invalid histogram levels '%s' (expected factors >= 2 such as 10,100).\n", argv[i]);
+                    return 1;
+                }
+                opts->hist_levels[opts->nb_hist_levels++] = (int)factor;
+                item = (*end == ',') ? end + 1 : end;
+            }
+            if (*item != '\0') {
+                if (verbose) printf("Error: At most %d histogram levels.\n", MAX_HIST_LEVELS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            opts->frame_bins = atoi(argv[++i]);
+            if (opts->frame_bins < 1) {
+                if (verbose) printf("Error: --frames must be a positive number of bins.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frame-memory") == 0 && i + 1 < argc) {
+            opts->frame_memory_mb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--numa-input") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "local") == 0) {
+                opts->numa_input = NUMA_INPUT_LOCAL;
+            } else if (strcmp(argv[i], "interleave") == 0) {
+                opts->numa_input = NUMA_INPUT_INTERLEAVE;
+            } else {
+                if (verbose) printf("Error: Unknown NUMA input placement '%s' (expected local or interleave).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            opts->pin = 1;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            opts->watch = 1;
+        } else if (strcmp(argv[i], "--shm") == 0) {
+            opts->shm = 1;
+        } else if (strcmp(argv[i], "--container") == 0 && i + 1 < argc) {
+            opts->container_path = argv[++i];
+        } else if (strcmp(argv[i], "--heat-format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "dense") == 0) {
+                opts->heat_format = HEAT_FORMAT_DENSE;
+            } else if (strcmp(argv[i], "auto") == 0) {
+                opts->heat_format = HEAT_FORMAT_AUTO;
+            } else {
+                if (verbose) printf("Error: Unknown heatmap format '%s' (expected dense or auto).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--aggregate") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "all") == 0) {
+                opts->aggregate = AGGREGATE_ALL;
+            } else if (strcmp(argv[i], "scenes") == 0) {
+                opts->aggregate = AGGREGATE_SCENES;
+            } else {
+                if (verbose) printf("Error: Unknown aggregate '%s' (expected all or scenes).\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc) {
+            opts->manifest_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            opts->trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0) {
+            opts->build_index = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            opts->pipeline = 1;
+        } else if (strcmp(argv[i], "--outputs") == 0 && i + 1 < argc) {
+            if (parse_outputs(argv[++i], opts) != 0) {
+                if (verbose) printf("Error: Invalid outputs '%s' (expected hist, heat or hist,heat).\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+
+    if (opts->folder_path == NULL && opts->manifest_path != NULL) {
+        opts->folder_path = ".";  // Manifest names are then relative to the working directory
+    }
+    if (opts->folder_path == NULL) {
+        if (verbose) printf("Error: Folder path not specified.\n");
+        return 1;
+    }
+    // A container record holds one histogram and one heatmap: no room for levels or frames
+    if (opts->container_path != NULL && (opts->nb_hist_levels > 0 || opts->frame_bins > 0)) {
+        if (verbose) printf("Error: --hist-levels and --frames cannot be combined with --container.\n");
+        return 1;
+    }
+
+    // The histogram covers the duration in whole bins (the last one may reach past it)
+    Geometry *g = &opts->geometry;
+    if (g->width < 1 || g->width > 65536 || g->height < 1 || g->height > 65536 ||
+        (long)g->width * g->height > MAX_PIXELS) {
+        if (verbose) printf("Error: Invalid sensor %dx%d (at most 65536 per side and %d pixels).\n",
+                            g->width, g->height, MAX_PIXELS);
+        return 1;
+    }
+    if (duration_ms < 1 || g->bin_us < 1 || g->bin_us > UINT32_MAX || ((uint64_t)duration_ms * 1000 + g->bin_us - 1) / g->bin_us > MAX_BINS) {
+        if (verbose) printf("Error: Invalid duration or bin width (at most %d bins).\n", MAX_BINS);
+        return 1;
+    }
+    g->millis = (int)(((uint64_t)duration_ms * 1000 + g->bin_us - 1) / g->bin_us);
+    if (opts->t_end < 0) {
+        opts->t_end = g->millis;
+    }
+    // One frame at least has to fit, and a window stays within an int MPI count
+    size_t frame_bytes = (size_t)g->width * g->height * sizeof(unsigned int);
+    if (opts->frame_bins > 0 && (opts->frame_memory_mb < 1 || opts->frame_memory_mb > 4096 ||
+                                 (size_t)opts->frame_memory_mb * 1024 * 1024 < frame_bytes)) {
+        if (verbose) printf("Error: --frame-memory must hold one %.2f MB frame and be at most 4096 MB.\n",
+                            frame_bytes / (1024.0 * 1024.0));
+        return 1;
+    }
+    if (opts->t_start < 0 || opts->t_end > g->millis || opts->t_start >= opts->t_end) {
+        if (verbose) printf("Error: Invalid time window [%d, %d) (expected 0 <= t-start < t-end <= %d bins).\n",
+                            opts->t_start, opts->t_end, g->millis);
+        return 1;
+    }
+    return 0;
+}
+
+const char *reader_name(ReaderMode reader) {
+    return reader == READER_MMAP ? "mmap" : "fread";
+}
+
+const char *heat_accum_name(HeatAccumMode mode) {
+    switch (mode) {
+        case HEAT_ACCUM_ATOMIC:    return "atomic";
+        case HEAT_ACCUM_OWNER:     return "owner";
+        case HEAT_ACCUM_PARTITION: return "partition";
+        default:                   return "private";
+    }
+}
+
+// Whether the threads of a rank add to a single shared heatmap (any of its columns may be written)
+int heat_accum_shared(HeatAccumMode mode) {
+    return mode == HEAT_ACCUM_ATOMIC || mode == HEAT_ACCUM_OWNER;
+}
+
+// Bytes of heatmap accumulation state a rank needs per file (including the final 2D heatmap)
+size_t heat_accum_footprint(HeatAccumMode mode, int num_threads) {
+    size_t heatmap_bytes = (size_t)WIDTH * HEIGHT * sizeof(unsigned int);
+    switch (mode) {
+        case HEAT_ACCUM_ATOMIC:
+            return heatmap_bytes;
+        case HEAT_ACCUM_OWNER:
+            return heatmap_bytes + (size_t)num_threads * (2 * EVENT_BATCH + num_threads + 1) * sizeof(unsigned int);
+        case HEAT_ACCUM_PARTITION:
+            return heatmap_bytes * (num_threads + 1) + (size_t)num_threads * 2 * EVENT_BATCH * sizeof(unsigned int);
+        default:
+            return heatmap_bytes * (num_threads + 1);
+    }
+}
+
+const char *schedule_name(ScheduleMode schedule) {
+    switch (schedule) {
+        case SCHEDULE_DYNAMIC: return "dynamic";
+        case SCHEDULE_SPLIT:   return "split";
+        default:               return "static";
+    }
+}
+
+// Span recording for --trace: every rank keeps its spans in memory and rank 0 writes them all
+// as a Chrome trace (chrome://tracing, Perfetto) at the end of the run
+void trace_init(const char *path) {
+    trace.enabled = (path != NULL);
+    trace.origin = omp_get_wtime();
+    if (trace.enabled) {
+        trace.spans = malloc(TRACE_MAX_SPANS * sizeof(TraceSpan));
+        if (trace.spans == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Record [start, end) (omp_get_wtime() values) on thread tid; safe from any thread
+void trace_span(const char *name, int tid, int file_idx, double start, double end,
+                double events, double bytes, double imbalance) {
+    if (!trace.enabled) {
+        return;
+    }
+
+    int slot;
+    #pragma omp atomic capture
+    slot = trace.nb_spans++;
+    if (slot >= TRACE_MAX_SPANS) {
+        return;  // Counted as dropped when written
+    }
+
+    TraceSpan *span = &trace.spans[slot];
+    strncpy(span->name, name, sizeof(span->name) - 1);
+    span->name[sizeof(span->name) - 1] = '\0';
+    span->tid = tid;
+    span->file_idx = file_idx;
+    span->start = start - trace.origin;
+    span->duration = end - start;
+    span->events = events;
+    span->bytes = bytes;
+    span->imbalance = imbalance;
+}
+
+// Write a string as a JSON string literal, escaping quotes, backslashes and control characters
+void json_write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// Gather the spans of every rank to rank 0 and write them as Chrome trace JSON
+int trace_write(const char *path, const FileList *file_list, int rank, int num_tasks) {
+    int nb_spans = trace.nb_spans < TRACE_MAX_SPANS ? trace.nb_spans : TRACE_MAX_SPANS;
+    int bytes = nb_spans * (int)sizeof(TraceSpan);
+    int *counts = NULL;
+    int *displs = NULL;
+    TraceSpan *all = NULL;
+
+    if (rank == 0) {
+        counts = malloc(num_tasks * sizeof(int));
+        displs = malloc(num_tasks * sizeof(int));
+    }
+    MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < num_tasks; r++) {
+            displs[r] = total;
+            total += counts[r];
+        }
+        all = malloc(total > 0 ? total : 1);
+        if (counts == NULL || displs == NULL || all == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    MPI_Gatherv(trace.spans, bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    int rc = 0;
+    if (rank == 0) {
+        FILE *out = fopen(path, "w");
+        if (!out) {
+            printf("Error: Could not create trace file %s\n", path);
+            rc = 1;
+        } else {
+            fprintf(out, "{\"traceEvents\":[\n");
+            for (int r = 0; r < num_tasks; r++) {
+                fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}},\n", r, r);
+                fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"writer\"}},\n",
+                        r, TRACE_TID_WRITER);
+                fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"prefetcher\"}},\n",
+                        r, TRACE_TID_PREFETCHER);
+
+                const TraceSpan *spans = (const TraceSpan *)((const char *)all + displs[r]);
+                for (int i = 0; i < counts[r] / (int)sizeof(TraceSpan); i++) {
+                    const TraceSpan *span = &spans[i];
+                    const char *file = (span->file_idx >= 0 && span->file_idx < file_list->nb_files)
+                                       ? file_list->names + file_list->name_offsets[span->file_idx] : "";
+                    fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                                 "\"args\":{\"file\":",
+                            span->name, r, span->tid, span->start * 1e6, span->duration * 1e6);
+                    json_write_string(out, file);  // File names may hold any character but '/'
+                    fprintf(out, ",\"events\":%.0f,\"bytes\":%.0f", span->events, span->bytes);
+                    if (span->imbalance > 0) {
+                        fprintf(out, ",\"imbalance\":%.3f", span->imbalance);
+                    }
+                    fprintf(out, "}},\n");
+                }
+            }
+            fprintf(out, "{\"name\":\"trace_end\",\"ph\":\"i\",\"pid\":0,\"tid\":0,\"ts\":0,\"s\":\"g\"}\n]}\n");
+            fclose(out);
+            printf("Trace saved to %s\n", path);
+        }
+        free(all);
+        free(counts);
+        free(displs);
+    }
+
+    if (trace.nb_spans > TRACE_MAX_SPANS) {
+        printf("Warning: Rank %d dropped %d trace spans\n", rank, trace.nb_spans - TRACE_MAX_SPANS);
+    }
+    free(trace.spans);
+    return rc;
+}
+
+// Map a whole input file read-only and hint the kernel that it will be streamed once
+int map_event_file(const char *path, MappedFile *mf) {
+    struct stat st;
+
+    mf->data = NULL;
+    mf->size = 0;
+    mf->fd = open(path, O_RDONLY);
+    if (mf->fd < 0) {
+        perror("open");
+        return -1;
+    }
+
+    if (fstat(mf->fd, &st) != 0 || st.st_size < (off_t)sizeof(unsigned int)) {
+        printf("Error: Input file %s is too small\n", path);
+        close(mf->fd);
+        return -1;
+    }
+    mf->size = (size_t)st.st_size;
+
+    void *addr = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, mf->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        close(mf->fd);
+        return -1;
+    }
+    mf->data = (const unsigned char *)addr;
+
+    madvise(addr, mf->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void unmap_event_file(MappedFile *mf) {
+    if (mf->data != NULL) {
+        munmap((void *)mf->data, mf->size);
+    }
+    if (mf->fd >= 0) {
+        close(mf->fd);
+    }
+    mf->data = NULL;
+    mf->fd = -1;
+}
+
+// Ask for readahead of [start, end) of a mapping (rounded out to whole pages)
+void prefetch_range(const MappedFile *mf, long start, long end) {
+    long page = sysconf(_SC_PAGESIZE);
+    long first = start & ~(page - 1);
+    if (end > first) {
+        madvise((void *)(mf->data + first), end - first, MADV_WILLNEED);
+    }
+}
+
+// Read which NUMA node each CPU of this rank belongs to (sysfs, no libnuma needed). Without
+// sysfs node information every allowed CPU is put on node 0.
+void read_numa_topology(NumaTopology *topo) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    memset(topo, 0, sizeof(*topo));
+    topo->cpus = malloc(CPU_SETSIZE * sizeof(int));
+    topo->cpu_node = malloc(CPU_SETSIZE * sizeof(int));
+    if (topo->cpus == NULL || topo->cpu_node == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    cpu_set_t placed;
+    CPU_ZERO(&placed);
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        char path[64];
+        char list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue;  // Node ids may have holes
+        }
+        if (fgets(list, sizeof(list), file) == NULL) {
+            list[0] = '\0';
+        }
+        fclose(file);
+
+        // cpulist format: "0-63,128-191"
+        int has_cpus = 0;
+        for (char *range = strtok(list, ",\n"); range != NULL; range = strtok(NULL, ",\n")) {
+            int first, last;
+            int fields = sscanf(range, "%d-%d", &first, &last);
+            if (fields < 1) {
+                continue;
+            }
+            if (fields == 1) {
+                last = first;
+            }
+            for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &placed)) {
+                    CPU_SET(cpu, &placed);
+                    topo->cpus[topo->nb_cpus] = cpu;
+                    topo->cpu_node[topo->nb_cpus] = node;
+                    topo->nb_cpus++;
+                    has_cpus = 1;
+                }
+            }
+        }
+        if (has_cpus) {
+            topo->node_mask |= 1UL << node;
+            topo->nb_nodes++;
+        }
+    }
+
+    // CPUs sysfs did not place (or no sysfs at all): node 0
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &placed)) {
+            topo->cpus[topo->nb_cpus] = cpu;
+            topo->cpu_node[topo->nb_cpus] = 0;
+            topo->nb_cpus++;
+            if (!(topo->node_mask & 1UL)) {
+                topo->node_mask |= 1UL;
+                topo->nb_nodes++;
+            }
+        }
+    }
+}
+
+// Pin OpenMP thread t to the t-th allowed CPU, node by node, so that consecutive threads share
+// a node and every file's thread t runs (and first-touches its partials) in the same place
+void pin_threads(NumaTopology *topo, int num_threads) {
+    topo->pinned = 0;
+    if (topo->nb_cpus == 0) {
+        return;
+    }
+
+    int failures = 0;
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel reduction(+:failures)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(topo->cpus[omp_get_thread_num() % topo->nb_cpus], &set);
+        failures += (sched_setaffinity(0, sizeof(set), &set) != 0);
+    }
+    topo->pinned = (failures == 0);
+}
+
+// Node that OpenMP thread t runs on once pinned (-1 if threads are not pinned)
+int thread_node(const NumaTopology *topo, int thread_id) {
+    if (!topo->pinned || topo->nb_cpus == 0) {
+        return -1;
+    }
+    return topo->cpu_node[thread_id % topo->nb_cpus];
+}
+
+void report_numa_topology(const NumaTopology *topo, const Options *opts, int rank, int num_threads) {
+    printf("Rank %d NUMA: %d node(s), %d CPU(s) allowed, input pages %s\n", rank, topo->nb_nodes, topo->nb_cpus,
+           topo->interleave_input ? "interleaved" : "node-local");
+    if (!topo->pinned) {
+        printf("Rank %d NUMA: threads not pinned%s\n", rank, opts->pin ? " (pinning failed)" : "");
+        return;
+    }
+    for (int node = 0; node < MAX_NUMA_NODES; node++) {
+        int first = -1, last = -1, count = 0;
+        for (int t = 0; t < num_threads; t++) {
+            if (thread_node(topo, t) == node) {
+                first = (first < 0) ? t : first;
+                last = t;
+                count++;
+            }
+        }
+        if (count > 0) {
+            printf("Rank %d NUMA: node %d runs %d thread(s) (%d-%d)\n", rank, node, count, first, last);
+        }
+    }
+}
+
+// Set (or clear) an interleave memory policy on the calling thread for the pages it faults next
+void set_interleave_policy(const NumaTopology *topo, int enable) {
+    unsigned long mask = topo->node_mask;
+    if (enable) {
+        syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, &mask, MAX_NUMA_NODES + 1);
+    } else {
+        syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    }
+}
+
+// Bring a whole file into the page cache: fault every page of the mapping, or stream the file
+// once for the fread reader
+void warm_file(const char *path, const MappedFile *mapped) {
+    if (mapped->data != NULL) {
+        long page = sysconf(_SC_PAGESIZE);
+        volatile unsigned char sink = 0;
+        madvise((void *)mapped->data, mapped->size, MADV_WILLNEED);
+        for (size_t off = 0; off < mapped->size; off += page) {
+            sink += mapped->data[off];
+        }
+        (void)sink;
+    } else {
+        int fd = open(path, O_RDONLY);
+        char *block = malloc(PREFETCH_BLOCK_BYTES);
+        if (fd >= 0 && block != NULL) {
+            while (read(fd, block, PREFETCH_BLOCK_BYTES) > 0) {
+            }
+        }
+        free(block);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+// Warm a file with its page cache pages spread over all nodes (--numa-input interleave); page
+// cache pages follow the memory policy of the thread that faults them
+void warm_interleaved(const NumaTopology *topo, const char *path, const MappedFile *mapped) {
+    set_interleave_policy(topo, 1);
+    warm_file(path, mapped);
+    set_interleave_policy(topo, 0);
+}
+
+// Raw format: the header count must match the file size; anything else starting with the
+// EVC1 magic is a columnar file
+int is_columnar_header(const unsigned char *header, size_t file_size) {
+    ColumnarHeader h;
+    unsigned int raw_count;
+
+    if (file_size < sizeof(ColumnarHeader)) {
+        return 0;
+    }
+    memcpy(&h, header, sizeof(h));
+    memcpy(&raw_count, header, sizeof(raw_count));
+    return memcmp(h.magic, COLUMNAR_MAGIC, 4) == 0 && h.version == COLUMNAR_VERSION &&
+           file_size != sizeof(unsigned int) + (size_t)raw_count * EVENT_SIZE_BYTES;
+}
+
+// Load and validate the block index of a columnar file (from the mapping or through file)
+int open_columnar_file(const char *path, EventFile *ef, const unsigned char *header, size_t file_size, FILE *file) {
+    ColumnarHeader h;
+    memcpy(&h, header, sizeof(h));
+
+    size_t index_bytes = (size_t)h.nb_blocks * sizeof(ColumnarBlock);
+    if (h.block_events == 0 || h.total_events > UINT32_MAX || sizeof(ColumnarHeader) + index_bytes > file_size) {
+        printf("Error: Corrupted columnar header in %s\n", path);
+        return -1;
+    }
+
+    ef->format = FORMAT_COLUMNAR;
+    ef->total_events = (unsigned int)h.total_events;
+    ef->first_timestamp = h.first_timestamp;
+    ef->block_events = h.block_events;
+    ef->nb_blocks = h.nb_blocks;
+    ef->flags = h.flags;
+    ef->blocks = malloc(index_bytes > 0 ? index_bytes : 1);
+    if (ef->blocks == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (file == NULL) {
+        memcpy(ef->blocks, ef->mapped.data + sizeof(ColumnarHeader), index_bytes);
+    } else if (fseek(file, sizeof(ColumnarHeader), SEEK_SET) != 0 ||
+               fread(ef->blocks, 1, index_bytes, file) != index_bytes) {
+        printf("Error: Could not read the block index of %s\n", path);
+        return -1;
+    }
+
+    // Event i must live in block i / block_events, and every block must fit in the file
+    uint64_t events = 0;
+    for (uint32_t b = 0; b < h.nb_blocks; b++) {
+        const ColumnarBlock *block = &ef->blocks[b];
+        int bad_width = block->ts_bytes != 2 && block->ts_bytes != 4 && block->ts_bytes != 8;
+        int bad_count = (b + 1 < h.nb_blocks) ? block->count != h.block_events : block->count > h.block_events;
+        if (bad_width || bad_count || block->offset + columnar_block_bytes(block) > file_size) {
+            printf("Error: Corrupted block %u in %s\n", b, path);
+            return -1;
+        }
+        events += block->count;
+    }
+    if (events != h.total_events) {
+        printf("Error: Block index of %s holds %lu events instead of %lu\n", path,
+               (unsigned long)events, (unsigned long)h.total_events);
+        return -1;
+    }
+    return 0;
+}
+
+void close_event_file(EventFile *ef) {
+    unmap_event_file(&ef->mapped);
+    free(ef->blocks);
+    ef->blocks = NULL;
+}
+
+// Open an input recording in either format and read its event count and first timestamp. With
+// the mmap reader the file stays mapped in ef->mapped for the threads; with the fread reader
+// only the header (and the block index of a columnar file) is read.
+int open_event_file(const char *path, ReaderMode reader, EventFile *ef) {
+    unsigned char header[sizeof(ColumnarHeader)] = {0};
+    size_t file_size;
+    FILE *file = NULL;
+    int rc = 0;
+
+    memset(ef, 0, sizeof(*ef));
+    ef->mapped.fd = -1;
+
+    if (reader == READER_MMAP) {
+        if (map_event_file(path, &ef->mapped) != 0) {
+            return -1;
+        }
+        file_size = ef->mapped.size;
+        memcpy(header, ef->mapped.data, file_size < sizeof(header) ? file_size : sizeof(header));
+    } else {
+        struct stat st;
+        file = fopen(path, "rb");
+        if (!file) {
+            return -1;
+        }
+        if (fstat(fileno(file), &st) != 0 || st.st_size < (off_t)sizeof(unsigned int)) {
+            fclose(file);
+            return -1;
+        }
+        file_size = (size_t)st.st_size;
+        fread(header, 1, sizeof(header), file);
+    }
+
+    ef->file_size = file_size;
+    if (is_columnar_header(header, file_size)) {
+        rc = open_columnar_file(path, ef, header, file_size, file);
+    } else {
+        ef->format = FORMAT_RAW;
+        memcpy(&ef->total_events, header, sizeof(unsigned int));
+
+        // Never trust the header beyond what the file actually holds
+        size_t available_events = (file_size - sizeof(unsigned int)) / EVENT_SIZE_BYTES;
+        if (ef->total_events > available_events) {
+            printf("Warning: %s announces %u events but only holds %zu\n", path, ef->total_events, available_events);
+            ef->total_events = (unsigned int)available_events;
+        }
+
+        if (ef->total_events > 0) {
+            memcpy(&ef->first_timestamp, header + sizeof(unsigned int), sizeof(uint64_t));
+        }
+    }
+
+    if (file) {
+        fclose(file);
+    }
+    if (rc != 0) {
+        close_event_file(ef);
+    }
+    return rc;
+}
+
+// Event count of a recording from its header alone (0 if unreadable)
+unsigned int peek_event_count(const char *path, uint64_t *file_size) {
+    unsigned char header[sizeof(ColumnarHeader)] = {0};
+    unsigned int total_events = 0;
+    struct stat st;
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    if (fstat(fileno(file), &st) == 0 && fread(header, 1, sizeof(header), file) >= sizeof(unsigned int)) {
+        *file_size = (uint64_t)st.st_size;
+        if (is_columnar_header(header, (size_t)st.st_size)) {
+            ColumnarHeader h;
+            memcpy(&h, header, sizeof(h));
+            total_events = h.total_events > UINT32_MAX ? UINT32_MAX : (unsigned int)h.total_events;
+        } else {
+            size_t available_events = ((size_t)st.st_size - sizeof(unsigned int)) / EVENT_SIZE_BYTES;
+            memcpy(&total_events, header, sizeof(unsigned int));
+            total_events = total_events > available_events ? (unsigned int)available_events : total_events;
+        }
+    }
+    fclose(file);
+    return total_events;
+}
+
+// Decode count raw 12-byte records (timestamp, x, y) into batch slots [at, at + count)
+static inline void decode_raw_records(const unsigned char *records, long count, uint64_t first_timestamp,
+                                      EventBatch *batch, long at) {
+    for (long e = 0; e < count; e++) {
+        const unsigned char *record = records + e * EVENT_SIZE_BYTES;
+        uint64_t timestamp;
+
+        // Each event: timestamp (64 bits) and x, y (16 bits each), with no alignment guarantee
+        memcpy(&timestamp, record, sizeof(uint64_t));
+        memcpy(&batch->x[at + e], record + sizeof(uint64_t), sizeof(unsigned short));
+        memcpy(&batch->y[at + e], record + sizeof(uint64_t) + sizeof(unsigned short), sizeof(unsigned short));
+        batch->t_offset[at + e] = timestamp - first_timestamp;
+    }
+}
+
+// Decode events [within, within + count) of a columnar block into batch slots [at, at + count).
+// The columns are contiguous, so every loop here is a plain widening copy.
+static inline void decode_columnar_block(const ColumnarBlock *block, const unsigned char *data, long within,
+                                         long count, uint64_t first_timestamp, EventBatch *batch, long at) {
+    const uint64_t base = block->base_timestamp - first_timestamp;
+    const unsigned char *x_column = data + (size_t)block->count * block->ts_bytes;
+    const unsigned char *y_column = x_column + (size_t)block->count * sizeof(uint16_t);
+    uint64_t *restrict t_offset = batch->t_offset + at;
+
+    if (block->ts_bytes == 2) {
+        const uint16_t *restrict delta = (const uint16_t *)data + within;
+        #pragma omp simd
+        for (long k = 0; k < count; k++) {
+            t_offset[k] = base + delta[k];
+        }
+    } else if (block->ts_bytes == 4) {
+        const uint32_t *restrict delta = (const uint32_t *)data + within;
+        #pragma omp simd
+        for (long k = 0; k < count; k++) {
+            t_offset[k] = base + delta[k];
+        }
+    } else {
+        const uint64_t *restrict delta = (const uint64_t *)data + within;
+        #pragma omp simd
+        for (long k = 0; k < count; k++) {
+            t_offset[k] = base + delta[k];
+        }
+    }
+    memcpy(batch->x + at, x_column + within * sizeof(uint16_t), count * sizeof(uint16_t));
+    memcpy(batch->y + at, y_column + within * sizeof(uint16_t), count * sizeof(uint16_t));
+}
+
+// Position a thread's cursor on events [first_event, last_event) of an opened file
+int cursor_open(EventCursor *c, const EventFile *ef, const char *path, ReaderMode reader,
+                long first_event, long last_event) {
+    c->ef = ef;
+    c->next = first_event;
+    c->end = last_event;
+    c->file = NULL;
+    c->buffer = NULL;
+    c->buffered_block = -1;
+
+    if (first_event >= last_event) {
+        return 0;
+    }
+
+    if (reader == READER_MMAP) {
+        // Kick off readahead of this thread's view while the others do the same
+        if (ef->format == FORMAT_RAW) {
+            prefetch_range(&ef->mapped, sizeof(unsigned int) + first_event * EVENT_SIZE_BYTES,
+                           sizeof(unsigned int) + last_event * EVENT_SIZE_BYTES);
+        } else {
+            const ColumnarBlock *first_block = &ef->blocks[first_event / ef->block_events];
+            const ColumnarBlock *last_block = &ef->blocks[(last_event - 1) / ef->block_events];
+            prefetch_range(&ef->mapped, first_block->offset, last_block->offset + columnar_block_bytes(last_block));
+        }
+        return 0;
+    }
+
+    // Open the file separately in each thread; the buffer holds a batch of records or one block
+    size_t buffer_size = (ef->format == FORMAT_RAW)
+                         ? (size_t)EVENT_BATCH * EVENT_SIZE_BYTES
+                         : (size_t)ef->block_events * (sizeof(uint64_t) + 2 * sizeof(uint16_t));
+    c->file = fopen(path, "rb");
+    c->buffer = aligned_alloc(64, (buffer_size + 63) & ~(size_t)63);
+    if (!c->file || !c->buffer) {
+        return -1;
+    }
+    if (ef->format == FORMAT_RAW) {
+        // Move to the starting position of this thread's part
+        fseek(c->file, sizeof(unsigned int) + first_event * EVENT_SIZE_BYTES, SEEK_SET);
+    }
+    return 0;
+}
+
+// Decode the next (up to EVENT_BATCH) events of the cursor; returns how many were decoded
+long cursor_next_batch(EventCursor *c, EventBatch *batch) {
+    const EventFile *ef = c->ef;
+    long n = 0;
+
+    while (n < EVENT_BATCH && c->next < c->end) {
+        long want = EVENT_BATCH - n;
+        if (want > c->end - c->next) {
+            want = c->end - c->next;
+        }
+
+        if (ef->format == FORMAT_RAW) {
+            const unsigned char *records;
+            if (c->file == NULL) {
+                records = ef->mapped.data + sizeof(unsigned int) + c->next * EVENT_SIZE_BYTES;
+            } else {
+                want = (long)fread(c->buffer, EVENT_SIZE_BYTES, want, c->file);
+                if (want == 0) {
+                    c->end = c->next;  // Short read: stop here
+                    break;
+                }
+                records = c->buffer;
+            }
+            decode_raw_records(records, want, ef->first_timestamp, batch, n);
+        } else {
+            long b = c->next / ef->block_events;
+            const ColumnarBlock *block = &ef->blocks[b];
+            long within = c->next - b * (long)ef->block_events;
+            if (want > (long)block->count - within) {
+                want = (long)block->count - within;
+            }
+
+            const unsigned char *data;
+            if (c->file == NULL) {
+                data = ef->mapped.data + block->offset;
+            } else {
+                if (c->buffered_block != b) {
+                    size_t bytes = columnar_block_bytes(block);
+                    if (fseek(c->file, block->offset, SEEK_SET) != 0 || fread(c->buffer, 1, bytes, c->file) != bytes) {
+                        c->end = c->next;
+                        break;
+                    }
+                    c->buffered_block = b;
+                }
+                data = c->buffer;
+            }
+            decode_columnar_block(block, data, within, want, ef->first_timestamp, batch, n);
+        }
+
+        n += want;
+        c->next += want;
+    }
+
+    batch->count = n;
+    return n;
+}
+
+void cursor_close(EventCursor *c) {
+    if (c->file) {
+        fclose(c->file);
+    }
+    free(c->buffer);
+    c->file = NULL;
+    c->buffer = NULL;
+}
+
+// Update a thread's private histogram and/or a (private or shared) x-major heatmap with a batch of
+// decoded events. Always inlined so that each (do_hist, heat_update) call site becomes its own loop,
+// with the geometry folded in where the caller passes constants.
+static inline __attribute__((always_inline))
+void accumulate_batch(const EventBatch *batch, unsigned int *occurrences, unsigned int *heatmap,
+                      int do_hist, int heat_update, int width, int height, int millis, uint64_t bin_us) {
+    for (long e = 0; e < batch->count; e++) {
+        if (do_hist) {
+            uint64_t bin = batch->t_offset[e] / bin_us;
+            if (bin < (uint64_t)millis) {
+                occurrences[bin]++;
+            }
+        }
+
+        unsigned short x = batch->x[e];
+        unsigned short y = batch->y[e];
+        if (heat_update != HEAT_UPDATE_NONE && x < width && y < height) {
+            if (heat_update == HEAT_UPDATE_ATOMIC) {
+                #pragma omp atomic update
+                heatmap[x * height + y]++;
+            } else {
+                heatmap[x * height + y]++;
+            }
+        }
+    }
+}
+
+// Every (do_hist, heat_update) loop for one geometry
+static inline __attribute__((always_inline))
+void accumulate_modes(const EventBatch *batch, unsigned int *occurrences, unsigned int *heatmap,
+                      int do_hist, int heat_update, int width, int height, int millis, uint64_t bin_us) {
+    if (do_hist) {
+        switch (heat_update) {
+            case HEAT_UPDATE_PLAIN:
+                accumulate_batch(batch, occurrences, heatmap, 1, HEAT_UPDATE_PLAIN, width, height, millis, bin_us);
+                break;
+            case HEAT_UPDATE_ATOMIC:
+                accumulate_batch(batch, occurrences, heatmap, 1, HEAT_UPDATE_ATOMIC, width, height, millis, bin_us);
+                break;
+            default:
+                accumulate_batch(batch, occurrences, heatmap, 1, HEAT_UPDATE_NONE, width, height, millis, bin_us);
+        }
+    } else if (heat_update == HEAT_UPDATE_PLAIN) {
+        accumulate_batch(batch, occurrences, heatmap, 0, HEAT_UPDATE_PLAIN, width, height, millis, bin_us);
+    } else if (heat_update == HEAT_UPDATE_ATOMIC) {
+        accumulate_batch(batch, occurrences, heatmap, 0, HEAT_UPDATE_ATOMIC, width, height, millis, bin_us);
+    }
+}
+
+// First index in [lo, hi) of a sorted batch whose time offset is >= bound (hi if none), found
+// by galloping from lo: runs of one bin are usually much shorter than a batch
+static inline long gallop_batch(const uint64_t *t_offset, long lo, long hi, uint64_t bound) {
+    long step = 1;
+    long below = lo;  // t_offset[below] < bound is known for below > lo
+    while (lo + step < hi && t_offset[lo + step] < bound) {
+        below = lo + step;
+        step *= 2;
+    }
+    long above = (lo + step < hi) ? lo + step : hi;
+    while (below < above) {
+        long mid = below + (above - below) / 2;
+        if (t_offset[mid] < bound) {
+            below = mid + 1;
+        } else {
+            above = mid;
+        }
+    }
+    return below;
+}
+
+// Histogram a batch as runs of equal bins, with one division per run instead of per event.
+// Returns 0 (nothing counted) if the batch is not sorted so that the caller uses the per-event path.
+int histogram_sorted_batch(const EventBatch *batch, unsigned int *occurrences) {
+    const uint64_t *t_offset = batch->t_offset;
+    int unsorted = 0;
+    #pragma omp simd reduction(|:unsorted)
+    for (long e = 1; e < batch->count; e++) {
+        unsorted |= t_offset[e] < t_offset[e - 1];
+    }
+    if (unsorted) {
+        return 0;
+    }
+
+    long e = 0;
+    uint64_t bin_us = BIN_US, millis = (uint64_t)MILLIS;
+    while (e < batch->count) {
+        uint64_t bin = t_offset[e] / bin_us;
+        if (bin >= millis) {
+            break;  // Sorted: every later event is out of range too
+        }
+        long end = gallop_batch(t_offset, e, batch->count, (bin + 1) * bin_us);
+        occurrences[bin] += (unsigned int)(end - e);
+        e = end;
+    }
+    return 1;
+}
+
+// Pick the specialised accumulate_batch() loop for a run-time combination. The common sensors with
+// 1 ms bins get loops with a constant row length and bin width; other set-ups use the run-time ones.
+void accumulate_dispatch(const EventBatch *batch, unsigned int *occurrences, unsigned int *heatmap,
+                         int do_hist, int heat_update) {
+    if (do_hist && histogram_sorted_batch(batch, occurrences)) {
+        do_hist = 0;  // Only the heatmap is left to do
+    }
+
+    if (BIN_US == 1000 && WIDTH == 640 && HEIGHT == 480) {
+        accumulate_modes(batch, occurrences, heatmap, do_hist, heat_update, 640, 480, MILLIS, 1000);
+    } else if (BIN_US == 1000 && WIDTH == 1280 && HEIGHT == 720) {
+        accumulate_modes(batch, occurrences, heatmap, do_hist, heat_update, 1280, 720, MILLIS, 1000);
+    } else {
+        accumulate_modes(batch, occurrences, heatmap, do_hist, heat_update, WIDTH, HEIGHT, MILLIS, BIN_US);
+    }
+}
+
+// --frames: add a batch to a stack of frames of the current window. Events of other windows, after
+// the last bin or outside the sensor are left out.
+static inline __attribute__((always_inline))
+void add_frames(const EventBatch *batch, const FrameWindow *frames, unsigned int *stack, int atomic) {
+    int width = WIDTH, height = HEIGHT;
+    size_t frame_pixels = (size_t)width * height;
+    uint64_t end = (uint64_t)MILLIS * BIN_US;
+    uint64_t first = (uint64_t)frames->first, count = (uint64_t)frames->count;
+    for (long e = 0; e < batch->count; e++) {
+        uint64_t t = batch->t_offset[e];
+        uint64_t frame = t / frames->frame_us - first;  // Wraps around for earlier windows
+        unsigned short x = batch->x[e];
+        unsigned short y = batch->y[e];
+        if (t < end && frame < count && x < width && y < height) {
+            if (atomic) {
+                #pragma omp atomic update
+                stack[frame * frame_pixels + (size_t)x * height + y]++;
+            } else {
+                stack[frame * frame_pixels + (size_t)x * height + y]++;
+            }
+        }
+    }
+}
+
+// --frames: add a batch to the thread's own copy of the window, or to the shared stack
+static void accumulate_frames(const EventBatch *batch, const FrameWindow *frames, int thread_id) {
+    if (frames->partials != NULL) {
+        size_t window_pixels = (size_t)frames->count * WIDTH * HEIGHT;
+        add_frames(batch, frames, frames->partials + (size_t)thread_id * window_pixels, 0);
+    } else {
+        add_frames(batch, frames, frames->stack, 1);
+    }
+}
+
+// --frames: zero the thread's own copy of the window before a pass (first-touching it on its node)
+static void clear_frame_partial(const FrameWindow *frames, int thread_id) {
+    if (frames->partials != NULL) {
+        size_t window_pixels = (size_t)frames->count * WIDTH * HEIGHT;
+        memset(frames->partials + (size_t)thread_id * window_pixels, 0, window_pixels * sizeof(unsigned int));
+    }
+}
+
+// Time offset of event i of a mapped file, read in place (random access for the searches below)
+static inline uint64_t mapped_time_offset(const EventFile *ef, long i) {
+    uint64_t timestamp;
+    if (ef->format == FORMAT_RAW) {
+        memcpy(&timestamp, ef->mapped.data + sizeof(unsigned int) + i * EVENT_SIZE_BYTES, sizeof(uint64_t));
+    } else {
+        const ColumnarBlock *block = &ef->blocks[i / ef->block_events];
+        long within = i % ef->block_events;
+        uint64_t delta = 0;
+        memcpy(&delta, ef->mapped.data + block->offset + (size_t)within * block->ts_bytes, block->ts_bytes);  // Little endian
+        timestamp = block->base_timestamp + delta;
+    }
+    return timestamp - ef->first_timestamp;
+}
+
+// First event in [lo, hi) of a sorted mapped file whose time offset is >= bound (hi if none),
+// galloping from lo
+long gallop_mapped(const EventFile *ef, long lo, long hi, uint64_t bound) {
+    long step = 1;
+    long below = lo;
+    while (lo + step - 1 < hi && mapped_time_offset(ef, lo + step - 1) < bound) {
+        below = lo + step;
+        step *= 2;
+    }
+    long above = (lo + step - 1 < hi) ? lo + step - 1 : hi;
+    while (below < above) {
+        long mid = below + (above - below) / 2;
+        if (mapped_time_offset(ef, mid) < bound) {
+            below = mid + 1;
+        } else {
+            above = mid;
+        }
+    }
+    return below;
+}
+
+// Bin starts of a file known to be sorted, found by searching the mapped timestamps instead of
+// reading every event. Each thread gallops through a contiguous range of bins.
+uint64_t *search_bin_starts(const EventFile *ef) {
+    uint64_t *bin_starts = malloc((MILLIS + 1) * sizeof(uint64_t));
+    if (bin_starts == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel
+    {
+        int num_threads = omp_get_num_threads();
+        int thread_id = omp_get_thread_num();
+        int first_bin = (int)((long)(MILLIS + 1) * thread_id / num_threads);
+        int last_bin = (int)((long)(MILLIS + 1) * (thread_id + 1) / num_threads);
+
+        long pos = 0;
+        for (int b = first_bin; b < last_bin; b++) {
+            pos = gallop_mapped(ef, pos, ef->total_events, (uint64_t)b * BIN_US);
+            bin_starts[b] = pos;
+        }
+    }
+    return bin_starts;
+}
+
+// Drop the events of a batch that fall outside [lo_us, hi_us) (relative to the first timestamp)
+void filter_batch(EventBatch *batch, uint64_t lo_us, uint64_t hi_us) {
+    long kept = 0;
+    for (long e = 0; e < batch->count; e++) {
+        uint64_t t = batch->t_offset[e];
+        batch->t_offset[kept] = t;
+        batch->x[kept] = batch->x[e];
+        batch->y[kept] = batch->y[e];
+        kept += (t >= lo_us && t < hi_us);
+    }
+    batch->count = kept;
+}
+
+void time_index_filename(const char *input_filename, char *index_filename) {
+    snprintf(index_filename, MAX_FILENAME_LENGTH, "%s%s", input_filename, TIME_INDEX_SUFFIX);
+}
+
+// Load the sidecar index of a recording; NULL if missing, stale or built for other bins.
+// *unsorted is set when a valid index records that the recording is not timestamp-sorted.
+uint64_t *load_time_index(const char *input_filename, const EventFile *ef, int *unsorted) {
+    char index_filename[MAX_FILENAME_LENGTH];
+    TimeIndexHeader header;
+    struct stat st;
+
+    *unsorted = 0;
+    time_index_filename(input_filename, index_filename);
+    if (stat(input_filename, &st) != 0) {
+        return NULL;
+    }
+    FILE *file = fopen(index_filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    uint64_t *bin_starts = NULL;
+    int valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                memcmp(header.magic, TIME_INDEX_MAGIC, 4) == 0 && header.version == TIME_INDEX_VERSION &&
+                header.source_size == (uint64_t)st.st_size && header.source_mtime == (int64_t)st.st_mtime &&
+                header.total_events == ef->total_events;
+    if (valid && (header.flags & TIME_INDEX_FLAG_UNSORTED)) {
+        *unsorted = 1;  // Whatever the binning
+    } else if (valid && header.nb_bins == (uint32_t)MILLIS && header.bin_us == BIN_US) {
+        bin_starts = malloc(((size_t)MILLIS + 1) * sizeof(uint64_t));
+        if (bin_starts && fread(bin_starts, sizeof(uint64_t), (size_t)MILLIS + 1, file) != (size_t)MILLIS + 1) {
+            free(bin_starts);
+            bin_starts = NULL;
+        }
+    }
+    fclose(file);
+
+    // Entries must be non-decreasing and within the file
+    for (int b = 0; bin_starts != NULL && b <= MILLIS; b++) {
+        if (bin_starts[b] > ef->total_events || (b > 0 && bin_starts[b] < bin_starts[b - 1])) {
+            free(bin_starts);
+            bin_starts = NULL;
+        }
+    }
+    return bin_starts;
+}
+
+// Scan a whole recording to find where every bin starts, one contiguous chunk of events
+// per thread. Each thread fills the bins starting inside its chunk; the bins starting at a
+// chunk boundary are filled afterwards. Returns NULL if the file could not be read, or with
+// *unsorted set if the timestamps are not sorted.
+uint64_t *build_time_index(const char *input_filename, const EventFile *ef, ReaderMode reader,
+                           int num_threads, int *unsorted) {
+    typedef struct {
+        long first, last;          // Events of the chunk
+        uint64_t first_t, last_t;  // Their first and last timestamps
+        int sorted, complete;
+    } IndexChunk;
+
+    uint64_t *bin_starts = malloc((MILLIS + 1) * sizeof(uint64_t));
+    IndexChunk *chunks = calloc(num_threads, sizeof(IndexChunk));
+    if (bin_starts == NULL || chunks == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Chunk bounds are rounded up to whole columnar blocks
+    long total_events = ef->total_events;
+    long align = (ef->format == FORMAT_COLUMNAR) ? (long)ef->block_events : 1;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int thread_id = omp_get_thread_num();
+        IndexChunk *chunk = &chunks[thread_id];
+        long first = ((long long)total_events * thread_id / num_threads + align - 1) / align * align;
+        long last = ((long long)total_events * (thread_id + 1) / num_threads + align - 1) / align * align;
+        chunk->first = first < total_events ? first : total_events;
+        chunk->last = last < total_events ? last : total_events;
+        chunk->sorted = 1;
+
+        EventBatch *batch = malloc(sizeof(EventBatch));
+        if (batch == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        EventCursor cursor;
+        long event = chunk->first;
+        uint64_t previous = 0;
+        if (chunk->first < chunk->last &&
+            cursor_open(&cursor, ef, input_filename, reader, chunk->first, chunk->last) == 0) {
+            while (chunk->sorted && cursor_next_batch(&cursor, batch) > 0) {
+                for (long e = 0; e < batch->count; e++, event++) {
+                    uint64_t t = batch->t_offset[e];
+                    if (event == chunk->first) {
+                        chunk->first_t = t;
+                    } else if (t < previous) {
+                        chunk->sorted = 0;
+                        break;
+                    }
+
+                    // Bins starting after the previous event of the chunk start here
+                    for (uint64_t bin = previous / BIN_US + 1; event > chunk->first && bin <= t / BIN_US && bin <= (uint64_t)MILLIS; bin++) {
+                        #pragma omp atomic write
+                        bin_starts[bin] = event;
+                    }
+                    previous = t;
+                }
+            }
+            cursor_close(&cursor);
+        }
+        chunk->last_t = previous;
+        chunk->complete = (event == chunk->last) || !chunk->sorted;
+        free(batch);
+    }
+
+    // Bins before the first event of every chunk start at that event, bins after the last
+    // event of the file at its end
+    int sorted = 1;
+    int complete = 1;
+    int next_bin = 0;
+    uint64_t previous = 0;
+    for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+        const IndexChunk *chunk = &chunks[thread_id];
+        if (chunk->first == chunk->last) {
+            continue;
+        }
+        sorted = sorted && chunk->sorted && chunk->first_t >= previous;
+        complete = complete && chunk->complete;
+        while (next_bin <= MILLIS && (uint64_t)next_bin <= chunk->first_t / BIN_US) {
+            bin_starts[next_bin++] = chunk->first;
+        }
+        uint64_t last_bin = chunk->last_t / BIN_US;
+        next_bin = last_bin < (uint64_t)MILLIS ? (int)last_bin + 1 : MILLIS + 1;
+        previous = chunk->last_t;
+    }
+    while (next_bin <= MILLIS) {
+        bin_starts[next_bin++] = total_events;
+    }
+    free(chunks);
+
+    *unsorted = !sorted;
+    if (!sorted) {
+        printf("Note: %s is not timestamp-sorted, no time index built\n", input_filename);
+    } else if (!complete) {
+        printf("Error: Could not read %s to build its time index\n", input_filename);
+    }
+    if (!complete || !sorted) {
+        free(bin_starts);
+        return NULL;
+    }
+    return bin_starts;
+}
+
+// Broadcast the index found by the owner of a file (NULL if it has none) to every rank of comm
+uint64_t *share_time_index(uint64_t *bin_starts, int owner, MPI_Comm comm) {
+    int rank;
+    int have_index = (bin_starts != NULL);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Bcast(&have_index, 1, MPI_INT, owner, comm);
+    if (!have_index) {
+        return NULL;
+    }
+    if (rank != owner) {
+        bin_starts = malloc((MILLIS + 1) * sizeof(uint64_t));
+        if (bin_starts == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    MPI_Bcast(bin_starts, MILLIS + 1, MPI_UINT64_T, owner, comm);
+    return bin_starts;
+}
+
+// Write the sidecar index next to the recording (through a temporary file so that readers
+// never see a partial index). Without bin_starts, the index only marks the recording unsorted.
+int write_time_index(const char *input_filename, const EventFile *ef, const uint64_t *bin_starts) {
+    char index_filename[MAX_FILENAME_LENGTH];
+    char tmp_filename[MAX_FILENAME_LENGTH + 8];
+    TimeIndexHeader header = {0};
+    struct stat st;
+
+    if (stat(input_filename, &st) != 0) {
+        return 1;
+    }
+    memcpy(header.magic, TIME_INDEX_MAGIC, 4);
+    header.version = TIME_INDEX_VERSION;
+    header.source_size = (uint64_t)st.st_size;
+    header.source_mtime = (int64_t)st.st_mtime;
+    header.total_events = ef->total_events;
+    header.nb_bins = MILLIS;
+    header.bin_us = (uint32_t)BIN_US;
+    header.flags = (bin_starts == NULL) ? TIME_INDEX_FLAG_UNSORTED : 0;
+
+    time_index_filename(input_filename, index_filename);
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", index_filename);
+    FILE *file = fopen(tmp_filename, "wb");
+    if (!file) {
+        printf("Error: Could not create index file %s\n", tmp_filename);
+        return 1;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             (bin_starts == NULL || fwrite(bin_starts, sizeof(uint64_t), (size_t)MILLIS + 1, file) == (size_t)MILLIS + 1);
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tmp_filename, index_filename) != 0) {
+        printf("Error: Could not write index file %s\n", index_filename);
+        remove(tmp_filename);
+        return 1;
+    }
+    printf("Index saved to %s\n", index_filename);
+    return 0;
+}
+
+// Sum num_partials contiguous arrays of n counters into out. Work is split into tiles of
+// REDUCE_TILE counters so that each tile is read from every partial while it stays in cache,
+// and the inner loops run across neighbouring counters so they vectorise.
+void reduce_partials(unsigned int *partials, int num_partials, size_t n, unsigned int *out, ReduceMode mode) {
+    size_t nb_tiles = (n + REDUCE_TILE - 1) / REDUCE_TILE;
+    int parallel = (n * num_partials >= REDUCE_PARALLEL_MIN);
+
+    if (mode == REDUCE_TREE) {
+        // Level by level, partial i absorbs partial i + stride; partial 0 ends up with the total
+        for (int stride = 1; stride < num_partials; stride *= 2) {
+            long nb_pairs = (num_partials + 2 * stride - 1) / (2 * stride);
+            #pragma omp parallel for collapse(2) schedule(static) if (parallel)
+            for (long pair = 0; pair < nb_pairs; pair++) {
+                for (size_t tile = 0; tile < nb_tiles; tile++) {
+                    long i = pair * 2 * stride;
+                    if (i + stride >= num_partials) {
+                        continue;
+                    }
+                    size_t begin = tile * REDUCE_TILE;
+                    size_t len = (n - begin < REDUCE_TILE) ? n - begin : REDUCE_TILE;
+                    unsigned int *restrict dst = partials + i * n + begin;
+                    const unsigned int *restrict src = partials + (i + stride) * n + begin;
+                    #pragma omp simd
+                    for (size_t k = 0; k < len; k++) {
+                        dst[k] += src[k];
+                    }
+                }
+            }
+        }
+        memcpy(out, partials, n * sizeof(unsigned int));
+        return;
+    }
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t tile = 0; tile < nb_tiles; tile++) {
+        size_t begin = tile * REDUCE_TILE;
+        size_t len = (n - begin < REDUCE_TILE) ? n - begin : REDUCE_TILE;
+        unsigned int *restrict dst = out + begin;
+
+        memcpy(dst, partials + begin, len * sizeof(unsigned int));
+        for (int i = 1; i < num_partials; i++) {
+            const unsigned int *restrict src = partials + (size_t)i * n + begin;
+            #pragma omp simd
+            for (size_t k = 0; k < len; k++) {
+                dst[k] += src[k];
+            }
+        }
+    }
+}
+
+// Owner heatmap accumulation: bucket the pixel indices of a batch by the thread owning their x band.
+// route_buf receives the indices grouped by owner; bucket t is [route_offsets[t], route_offsets[t + 1]).
+void route_batch(const EventBatch *batch, const int *x_owner, int num_threads,
+                 unsigned int *pixels, unsigned int *route_buf, int *route_offsets) {
+    long valid = 0;
+
+    for (int t = 0; t <= num_threads; t++) {
+        route_offsets[t] = 0;
+    }
+
+    // Pass 1: pixel index of every in-range event and size of every bucket
+    int width = WIDTH, height = HEIGHT;
+    for (long e = 0; e < batch->count; e++) {
+        unsigned short x = batch->x[e];
+        unsigned short y = batch->y[e];
+        if (x < width && y < height) {
+            pixels[valid++] = x * height + y;
+            route_offsets[x_owner[x] + 1]++;
+        }
+    }
+    for (int t = 0; t < num_threads; t++) {
+        route_offsets[t + 1] += route_offsets[t];
+    }
+
+    // Pass 2: scatter into the buckets (pixel / HEIGHT recovers x)
+    int fill[num_threads];
+    memcpy(fill, route_offsets, num_threads * sizeof(int));
+    for (long e = 0; e < valid; e++) {
+        route_buf[fill[x_owner[pixels[e] / height]]++] = pixels[e];
+    }
+}
+
+// Partition heatmap accumulation: sort the pixel indices of a batch by tile (their high bits above
+// tile_shift) with a counting sort, then add them tile after tile to a thread's private heatmap, so
+// that each tile stays in cache while it is updated
+void partition_batch(const EventBatch *batch, unsigned int *heatmap, int tile_shift, int nb_tiles,
+                     unsigned int *pixels, unsigned int *tile_buf) {
+    int tile_offsets[nb_tiles + 1];
+    long valid = 0;
+
+    memset(tile_offsets, 0, (nb_tiles + 1) * sizeof(int));
+
+    // Pass 1: pixel index of every in-range event and size of every tile
+    int width = WIDTH, height = HEIGHT;
+    for (long e = 0; e < batch->count; e++) {
+        unsigned short x = batch->x[e];
+        unsigned short y = batch->y[e];
+        if (x < width && y < height) {
+            unsigned int pixel = x * height + y;
+            pixels[valid++] = pixel;
+            tile_offsets[(pixel >> tile_shift) + 1]++;
+        }
+    }
+    for (int t = 0; t < nb_tiles; t++) {
+        tile_offsets[t + 1] += tile_offsets[t];
+    }
+
+    // Pass 2: scatter into the tiles, then update the heatmap in tile order
+    for (long e = 0; e < valid; e++) {
+        tile_buf[tile_offsets[pixels[e] >> tile_shift]++] = pixels[e];
+    }
+    for (long k = 0; k < valid; k++) {
+        heatmap[tile_buf[k]]++;
+    }
+}
+
+// Append a recording to the manifest (size and event count 0 when not known yet)
+void file_list_add(FileList *file_list, const char *name, uint64_t file_size, unsigned int total_events) {
+    size_t length = strlen(name) + 1;
+
+    if (file_list->nb_files == file_list->capacity) {
+        file_list->capacity = file_list->capacity ? 2 * file_list->capacity : 1024;
+        file_list->name_offsets = realloc(file_list->name_offsets, file_list->capacity * sizeof(size_t));
+        file_list->file_sizes = realloc(file_list->file_sizes, file_list->capacity * sizeof(uint64_t));
+        file_list->total_events = realloc(file_list->total_events, file_list->capacity * sizeof(unsigned int));
+    }
+    if (file_list->names_bytes + length > file_list->names_capacity) {
+        file_list->names_capacity = 2 * (file_list->names_bytes + length);
+        file_list->names = realloc(file_list->names, file_list->names_capacity);
+    }
+    if (file_list->name_offsets == NULL || file_list->file_sizes == NULL ||
+        file_list->total_events == NULL || file_list->names == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(file_list->names + file_list->names_bytes, name, length);
+    file_list->name_offsets[file_list->nb_files] = file_list->names_bytes;
+    file_list->file_sizes[file_list->nb_files] = file_size;
+    file_list->total_events[file_list->nb_files] = total_events;
+    file_list->names_bytes += length;
+    file_list->nb_files++;
+}
+
+const char *file_list_name(const FileList *file_list, int file_idx) {
+    return file_list->names + file_list->name_offsets[file_idx];
+}
+
+// Full path of the file_idx-th input file
+void build_input_filename(const FileList *file_list, int file_idx, char *input_filename) {
+    const char *name = file_list_name(file_list, file_idx);
+    if (name[0] == '/') {
+        snprintf(input_filename, MAX_FILENAME_LENGTH, "%s", name);
+    } else {
+        snprintf(input_filename, MAX_FILENAME_LENGTH, "%s/%s", file_list->folder_name, name);
+    }
+}
+
+void free_file_list(FileList *file_list) {
+    free(file_list->folder_name);
+    free(file_list->names);
+    free(file_list->name_offsets);
+    free(file_list->file_sizes);
+    free(file_list->total_events);
+    memset(file_list, 0, sizeof(*file_list));
+}
+
+// Sidecar time indexes and their temporary files are not recordings
+int is_index_file(const char *name) {
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(TIME_INDEX_SUFFIX);
+    if (name_length >= suffix_length && strcmp(name + name_length - suffix_length, TIME_INDEX_SUFFIX) == 0) {
+        return 1;
+    }
+    return strstr(name, TIME_INDEX_SUFFIX ".tmp") != NULL;
+}
+
+int scan_directory(const char *folder_path, FileList *file_list) {
+
+    DIR *dir;
+    struct dirent *entry;
+
+    dir = opendir(folder_path);
+    if (dir == NULL) {
+        perror("opendir");
+        return -1;
+    }
+
+    // Names only: sizes and event counts are read afterwards by all ranks in parallel
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_REG && !is_index_file(entry->d_name)) {  // Regular file
+            file_list_add(file_list, entry->d_name, 0, 0);
+        }
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+// Load a manifest file: one recording per line, "name" or "name<TAB>size<TAB>events"
+// (names relative to the folder, or absolute); empty lines and lines starting with # are skipped
+int load_manifest(const char *manifest_path, FileList *file_list) {
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        printf("Error: Could not open manifest %s\n", manifest_path);
+        return -1;
+    }
+
+    char line[MAX_FILENAME_LENGTH + 64];
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        uint64_t file_size = 0;
+        unsigned long total_events = 0;
+        char *tab = strchr(line, '\t');
+        if (tab != NULL) {
+            *tab = '\0';
+            if (sscanf(tab + 1, "%" SCNu64 "\t%lu", &file_size, &total_events) != 2) {
+                file_size = 0;
+                total_events = 0;
+            }
+        }
+        file_list_add(file_list, line, file_size, (unsigned int)total_events);
+    }
+
+    fclose(manifest);
+    return 0;
+}
+
+// Send the bytes of a buffer from rank 0 in pieces that fit an int count
+void bcast_bytes(void *buffer, size_t bytes) {
+    const size_t piece = (size_t)1 << 30;
+    for (size_t offset = 0; offset < bytes; offset += piece) {
+        size_t count = (bytes - offset < piece) ? bytes - offset : piece;
+        MPI_Bcast((char *)buffer + offset, (int)count, MPI_BYTE, 0, MPI_COMM_WORLD);
+    }
+}
+
+// Give every rank rank 0's manifest; only the bytes actually used are sent
+void broadcast_file_list(FileList *file_list, int rank) {
+    uint64_t header[3] = {0};
+    if (rank == 0) {
+        header[0] = (uint64_t)file_list->nb_files;
+        header[1] = strlen(file_list->folder_name) + 1;
+        header[2] = file_list->names_bytes;
+    }
+    MPI_Bcast(header, 3, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) {
+        file_list->nb_files = (int)header[0];
+        file_list->capacity = file_list->nb_files;
+        file_list->names_bytes = header[2];
+        file_list->names_capacity = header[2];
+        file_list->folder_name = malloc(header[1]);
+        file_list->names = malloc(header[2] > 0 ? header[2] : 1);
+        file_list->name_offsets = malloc((header[0] > 0 ? header[0] : 1) * sizeof(size_t));
+        file_list->file_sizes = malloc((header[0] > 0 ? header[0] : 1) * sizeof(uint64_t));
+        file_list->total_events = malloc((header[0] > 0 ? header[0] : 1) * sizeof(unsigned int));
+        if (file_list->folder_name == NULL || file_list->names == NULL || file_list->name_offsets == NULL ||
+            file_list->file_sizes == NULL || file_list->total_events == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bcast_bytes(file_list->folder_name, header[1]);
+    bcast_bytes(file_list->names, file_list->names_bytes);
+    bcast_bytes(file_list->file_sizes, file_list->nb_files * sizeof(uint64_t));
+    bcast_bytes(file_list->total_events, file_list->nb_files * sizeof(unsigned int));
+
+    // The offsets follow from the names
+    size_t offset = 0;
+    for (int i = 0; i < file_list->nb_files; i++) {
+        file_list->name_offsets[i] = offset;
+        offset += strlen(file_list->names + offset) + 1;
+    }
+}
+
+// Fill in the sizes and event counts the manifest does not have. Rank r reads the headers of
+// files r, r + num_tasks, ... with all its threads; the results are then combined on every rank.
+void read_file_info(FileList *file_list, int rank, int num_tasks) {
+    int n = file_list->nb_files;
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = rank; i < n; i += num_tasks) {
+        if (file_list->file_sizes[i] == 0 && file_list->total_events[i] == 0) {
+            char path[MAX_FILENAME_LENGTH];
+            build_input_filename(file_list, i, path);
+            file_list->total_events[i] = peek_event_count(path, &file_list->file_sizes[i]);
+        }
+    }
+
+    // Entries known beforehand are identical everywhere; the others are only set by their reader
+    if (n > 0) {
+        MPI_Allreduce(MPI_IN_PLACE, file_list->file_sizes, n, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, file_list->total_events, n, MPI_UNSIGNED, MPI_MAX, MPI_COMM_WORLD);
+    }
+}
+
+static const FileList *sort_list;  // qsort has no context argument
+
+static int compare_events_desc(const void *a, const void *b) {
+    int ia = *(const int *)a;
+    int ib = *(const int *)b;
+    unsigned int ea = sort_list->total_events[ia];
+    unsigned int eb = sort_list->total_events[ib];
+    if (ea != eb) {
+        return (ea < eb) - (ea > eb);
+    }
+    return (ia > ib) - (ia < ib);  // Same order on every rank
+}
+
+// Reorder files [first_file, nb_files) so that the ones with the most events come first
+void sort_files_by_events(FileList *file_list, int first_file) {
+    int n = file_list->nb_files - first_file;
+    int *order = malloc((n > 0 ? n : 1) * sizeof(int));
+    size_t *name_offsets = malloc((n > 0 ? n : 1) * sizeof(size_t));
+    uint64_t *file_sizes = malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    unsigned int *total_events = malloc((n > 0 ? n : 1) * sizeof(unsigned int));
+    if (order == NULL || name_offsets == NULL || file_sizes == NULL || total_events == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; i++) {
+        order[i] = first_file + i;
+    }
+    sort_list = file_list;
+    qsort(order, n, sizeof(int), compare_events_desc);
+
+    // The names stay in place; only their offsets move
+    for (int i = 0; i < n; i++) {
+        name_offsets[i] = file_list->name_offsets[order[i]];
+        file_sizes[i] = file_list->file_sizes[order[i]];
+        total_events[i] = file_list->total_events[order[i]];
+    }
+    memcpy(file_list->name_offsets + first_file, name_offsets, n * sizeof(size_t));
+    memcpy(file_list->file_sizes + first_file, file_sizes, n * sizeof(uint64_t));
+    memcpy(file_list->total_events + first_file, total_events, n * sizeof(unsigned int));
+
+    free(order);
+    free(name_offsets);
+    free(file_sizes);
+    free(total_events);
+}
+
+// Function implementations
+void get_base_name(const char *input_filename, char *base_name) {
+    const char *last_slash = strrchr(input_filename, '/');
+    const char *dot = strrchr(input_filename, '.');
+    
+    if (last_slash == NULL) {
+        last_slash = input_filename - 1;
+    }
+    if (dot == NULL || dot < last_slash) {
+        dot = input_filename + strlen(input_filename);
+    }
+    
+    strncpy(base_name, last_slash + 1, dot - last_slash - 1);
+    base_name[dot - last_slash - 1] = '\0';
+}
+
+
+// Split events [first_event, last_event) into one event range per thread. Inner bounds are
+// rounded up to a multiple of align so that no columnar block is shared between threads.
+void calculate_event_bounds(int num_threads, long first_event, long last_event, long align, long **bounds) {
+    *bounds = malloc((num_threads + 1) * sizeof(long));
+    if (!*bounds) {
+        printf("Error: Memory allocation failed.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long total_events = last_event - first_event;
+    long events_per_thread = total_events / num_threads;
+    if (total_events % num_threads != 0) {
+        events_per_thread++;
+    }
+
+    (*bounds)[0] = first_event;
+    for (int i = 1; i <= num_threads; i++) {
+        long bound = first_event + i * events_per_thread;
+        bound = (bound + align - 1) / align * align;
+        (*bounds)[i] = bound < last_event ? bound : last_event;
+    }
+}
+
+// Bound part of [lo, hi) split into num_parts: lo, hi, or part * (hi - lo) / num_parts rounded
+// up to a multiple of align
+long split_bound(long lo, long hi, int part, int num_parts, long align) {
+    if (part <= 0) {
+        return lo;
+    }
+    if (part >= num_parts) {
+        return hi;
+    }
+    long bound = lo + (long)((long long)(hi - lo) * part / num_parts);
+    bound = (bound + align - 1) / align * align;
+    return bound < hi ? bound : hi;
+}
+
+// Write one result array to a raw binary output file
+int write_output(const char *output_filename, const unsigned int *data, size_t count) {
+    FILE *output_file = fopen(output_filename, "wb");
+    if (!output_file) {
+        printf("Error: Could not create output file %s\n", output_filename);
+        return 1;
+    }
+
+    fwrite(data, sizeof(unsigned int), count, output_file);
+    fclose(output_file);
+    printf("Data saved to %s\n", output_filename);
+    return 0;
+}
+
+// Mark rows [lo, hi) as written
+static inline void dirty_add(DirtyRange *range, int lo, int hi) {
+    if (lo < hi) {
+        range->lo = lo < range->lo ? lo : range->lo;
+        range->hi = hi > range->hi ? hi : range->hi;
+    }
+}
+
+// Zero the written rows of row_length counters each and mark them clean
+static void clear_dirty_rows(unsigned int *data, size_t row_length, DirtyRange *range) {
+    if (range->lo < range->hi) {
+        memset(data + (size_t)range->lo * row_length, 0,
+               (size_t)(range->hi - range->lo) * row_length * sizeof(unsigned int));
+    }
+    range->lo = INT_MAX;
+    range->hi = 0;
+}
+
+// Widen the ranges with the bins and x columns a batch can write (either may be NULL), and count
+// the events the histogram or the heatmap will leave out
+static void mark_batch_dirty(const EventBatch *batch, DirtyRange *bins, DirtyRange *columns, OutOfRange *dropped) {
+    if (batch->count == 0) {
+        return;
+    }
+    if (bins != NULL) {
+        uint64_t lo = UINT64_MAX, hi = 0;
+        uint64_t end = (uint64_t)MILLIS * BIN_US;
+        long late = 0;
+        #pragma omp simd reduction(min:lo) reduction(max:hi) reduction(+:late)
+        for (long e = 0; e < batch->count; e++) {
+            lo = batch->t_offset[e] < lo ? batch->t_offset[e] : lo;
+            hi = batch->t_offset[e] > hi ? batch->t_offset[e] : hi;
+            late += batch->t_offset[e] >= end;
+        }
+        dropped->late += late;
+        dirty_add(bins, lo / BIN_US < (uint64_t)MILLIS ? (int)(lo / BIN_US) : MILLIS,
+                  hi / BIN_US < (uint64_t)MILLIS ? (int)(hi / BIN_US) + 1 : MILLIS);
+    }
+    if (columns != NULL) {
+        int lo = INT_MAX, hi = 0;
+        int width = WIDTH, height = HEIGHT;
+        long outside = 0;
+        #pragma omp simd reduction(min:lo) reduction(max:hi) reduction(+:outside)
+        for (long e = 0; e < batch->count; e++) {
+            lo = batch->x[e] < lo ? batch->x[e] : lo;
+            hi = batch->x[e] > hi ? batch->x[e] : hi;
+            outside += (batch->x[e] >= width) | (batch->y[e] >= height);
+        }
+        dropped->outside += outside;
+        dirty_add(columns, lo < WIDTH ? lo : WIDTH, hi < WIDTH ? hi + 1 : WIDTH);
+    }
+}
+
+#ifndef OFFLOADGPU
+// Give every one of nb_ranges ranges the union of them all (after a tree reduction)
+static void widen_dirty_ranges(DirtyRange *ranges, int nb_ranges) {
+    DirtyRange all = {INT_MAX, 0};
+    for (int i = 0; i < nb_ranges; i++) {
+        dirty_add(&all, ranges[i].lo, ranges[i].hi);
+    }
+    for (int i = 0; i < nb_ranges; i++) {
+        ranges[i] = all;
+    }
+}
+#endif // OFFLOADGPU
+
+// Allocate the buffers a combination of modes needs the first time it is used. New partials are
+// marked dirty as a whole so that each thread zeroes (and first-touches) its own on its node.
+void prepare_accumulators(Accumulators *acc, int num_threads, int thread_histograms, int private_heatmaps,
+                          int route_heatmaps) {
+    if (acc->num_threads == 0) {
+        acc->num_threads = num_threads;
+        acc->hist_dirty = malloc(num_threads * sizeof(DirtyRange));
+        acc->heat_dirty = malloc(num_threads * sizeof(DirtyRange));
+        acc->batches = calloc(num_threads, sizeof(EventBatch *));
+        acc->pixels = calloc(num_threads, sizeof(unsigned int *));
+        acc->tile_bufs = calloc(num_threads, sizeof(unsigned int *));
+        if (acc->hist_dirty == NULL || acc->heat_dirty == NULL || acc->batches == NULL || acc->pixels == NULL ||
+            acc->tile_bufs == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (thread_histograms && acc->occurrences_private == NULL) {
+        // Initialize arrays for counting occurrences
+        acc->occurrences_private = malloc(num_threads * MILLIS * sizeof(unsigned int));  // Private arrays for each thread
+        if (acc->occurrences_private == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int t = 0; t < num_threads; t++) {
+            acc->hist_dirty[t] = (DirtyRange){0, MILLIS};
+        }
+    }
+
+    if (private_heatmaps && acc->data_block_3d == NULL) {
+
+        // Allocate a contiguous block for the entire 3D matrix (page aligned: WIDTH * HEIGHT
+        // counters are a whole number of pages, so no page is shared by two threads)
+        acc->heatmap_3d = (unsigned int ***)malloc(num_threads * sizeof(unsigned int **));
+        acc->data_block_3d = (unsigned int *)aligned_alloc(4096, (size_t)num_threads * WIDTH * HEIGHT * sizeof(unsigned int));
+
+        // Check if allocation was successful
+        if (acc->heatmap_3d == NULL || acc->data_block_3d == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // Set up the pointers for the 3D array
+        for (int i = 0; i < num_threads; i++) {
+            acc->heatmap_3d[i] = (unsigned int **)malloc(WIDTH * sizeof(unsigned int *));
+            for (int j = 0; j < WIDTH; j++) {
+                // Each 2D slice points to the correct position in the contiguous block
+                acc->heatmap_3d[i][j] = acc->data_block_3d + (i * WIDTH * HEIGHT) + (j * HEIGHT);
+            }
+            acc->heat_dirty[i] = (DirtyRange){0, WIDTH};
+        }
+
+    }
+
+    // Owner mode: thread t owns the x band [t * WIDTH / num_threads, (t + 1) * WIDTH / num_threads)
+    if (route_heatmaps && acc->x_owner == NULL) {
+        acc->x_owner = malloc(WIDTH * sizeof(int));
+        acc->route_bufs = malloc((size_t)num_threads * EVENT_BATCH * sizeof(unsigned int));
+        acc->route_offsets = malloc((size_t)num_threads * (num_threads + 1) * sizeof(int));
+        if (acc->x_owner == NULL || acc->route_bufs == NULL || acc->route_offsets == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int x = 0; x < WIDTH; x++) {
+            acc->x_owner[x] = (int)((long)x * num_threads / WIDTH);
+        }
+    }
+}
+
+void free_accumulators(Accumulators *acc) {
+    for (int t = 0; t < acc->num_threads; t++) {
+        free(acc->batches[t]);
+        free(acc->pixels[t]);
+        free(acc->tile_bufs[t]);
+        if (acc->heatmap_3d != NULL) {
+            free(acc->heatmap_3d[t]);
+        }
+    }
+    free(acc->heatmap_3d);
+    free(acc->data_block_3d);
+    free(acc->occurrences_private);
+    free(acc->hist_dirty);
+    free(acc->heat_dirty);
+    free(acc->batches);
+    free(acc->pixels);
+    free(acc->tile_bufs);
+    free(acc->x_owner);
+    free(acc->route_bufs);
+    free(acc->route_offsets);
+    free(acc->frame_stack);
+    free(acc->frame_partials);
+    memset(acc, 0, sizeof(*acc));
+}
+
+// Accumulate events [first_event, last_event) of an input file with all OpenMP threads of this
+// rank and consolidate the per-thread partials into occurrences[MILLIS] / data_block_2d[WIDTH*HEIGHT].
+// With filter_window, events outside [opts->t_start, opts->t_end) are dropped after decoding.
+// When the bin starts of a sorted file are known, the histogram is counted from them directly.
+// The atomic and owner heatmap modes add to data_block_2d in place and widen *heat_dirty with the
+// x columns they wrote. With frames, the same pass fills the first window of --frames. Events past
+// the last bin or outside the sensor are counted in *dropped.
+// Returns the time spent in the parallel decode/accumulate region; the time spent combining the
+// per-thread partials goes to *reduce_time.
+double accumulate_events(const Options *opts, const char *input_filename, const EventFile *ef,
+                         long first_event, long last_event, int filter_window, const uint64_t *bin_starts,
+                         int num_threads, unsigned int *occurrences, unsigned int *data_block_2d,
+                         DirtyRange *heat_dirty, const FrameWindow *frames, OutOfRange *dropped,
+                         double *reduce_time) {
+
+    // Sorted fast path: bin b holds the events [bin_starts[b], bin_starts[b + 1]) of this range
+    int thread_histograms = opts->histograms && bin_starts == NULL;
+    *dropped = (OutOfRange){0, 0};
+    if (opts->histograms && bin_starts != NULL) {
+        for (int b = 0; b < MILLIS; b++) {
+            long lo = (long)bin_starts[b] > first_event ? (long)bin_starts[b] : first_event;
+            long hi = (long)bin_starts[b + 1] < last_event ? (long)bin_starts[b + 1] : last_event;
+            occurrences[b] = hi > lo ? (unsigned int)(hi - lo) : 0;
+        }
+        long late_start = (long)bin_starts[MILLIS] > first_event ? (long)bin_starts[MILLIS] : first_event;
+        dropped->late = last_event > late_start ? last_event - late_start : 0;
+    }
+    if (!thread_histograms && !opts->heatmaps && frames == NULL) {
+        last_event = first_event;  // Nothing left to decode
+    }
+
+    double alloc_start_time = omp_get_wtime();
+    double bytes_per_event = ef->total_events > 0 ? (double)ef->file_size / ef->total_events : 0.0;
+    long *bounds;
+    calculate_event_bounds(num_threads, first_event, last_event,
+                           ef->format == FORMAT_COLUMNAR ? (long)ef->block_events : 1, &bounds);
+    double *thread_times = calloc(num_threads, sizeof(double));
+
+    /********************************************************************************************/
+    /*              PREPARING SHARED MEMORIES FOR PARALLEL-PROCESSING WITH OPEN_MP              */
+    /********************************************************************************************/
+
+    int partition_heatmaps = opts->heatmaps && opts->heat_accum == HEAT_ACCUM_PARTITION;
+    int private_heatmaps = opts->heatmaps && !heat_accum_shared(opts->heat_accum);
+    int route_heatmaps = opts->heatmaps && opts->heat_accum == HEAT_ACCUM_OWNER;
+    int heat_update = HEAT_UPDATE_NONE;
+    if (opts->heatmaps) {
+        // The atomic and owner modes accumulate straight into the caller's data_block_2d
+        heat_update = (opts->heat_accum == HEAT_ACCUM_ATOMIC) ? HEAT_UPDATE_ATOMIC : HEAT_UPDATE_PLAIN;
+    }
+
+    // Partition mode: tiles of 2^tile_shift counters, widened on large sensors
+    int tile_shift = HEAT_TILE_SHIFT;
+    while ((((size_t)WIDTH * HEIGHT - 1) >> tile_shift) >= MAX_HEAT_TILES) {
+        tile_shift++;
+    }
+    int nb_tiles = (int)(((size_t)WIDTH * HEIGHT - 1) >> tile_shift) + 1;
+
+    Accumulators *acc = &accumulators;
+    prepare_accumulators(acc, num_threads, thread_histograms, private_heatmaps, route_heatmaps);
+    unsigned int *occurrences_private = acc->occurrences_private;
+    unsigned int *data_block_3d = acc->data_block_3d;
+
+
+    
+    /********************************************************************************************/
+    /*                            PARALLEL-PROCESSING WITH OPEN_MP                              */
+    /********************************************************************************************/
+    
+    long route_rounds = 0;
+    if (route_heatmaps) {
+        // Every thread takes part in every round (they exchange buckets between two barriers)
+        long events_per_thread = 0;
+        for (int t = 0; t < num_threads; t++) {
+            if (bounds[t + 1] - bounds[t] > events_per_thread) {
+                events_per_thread = bounds[t + 1] - bounds[t];
+            }
+        }
+        route_rounds = (events_per_thread + EVENT_BATCH - 1) / EVENT_BATCH;
+    }
+
+    // Set the number of OpenMP threads
+    omp_set_num_threads(num_threads);
+
+    double read_start_time = omp_get_wtime();
+    trace_span("alloc", 0, trace.file_idx, alloc_start_time, read_start_time, 0, 0, 0);
+
+    #pragma omp parallel // START OF MAIN PROCESSING
+    {
+        double start_time = omp_get_wtime();  // Measure time taken by each thread
+
+        int thread_id = omp_get_thread_num();
+        EventCursor cursor;
+
+        // Decode buffers are allocated by their thread on its first file and then reused
+        if (acc->batches[thread_id] == NULL) {
+            acc->batches[thread_id] = aligned_alloc(64, (sizeof(EventBatch) + 63) & ~(size_t)63);
+        }
+        if ((route_heatmaps || partition_heatmaps) && acc->pixels[thread_id] == NULL) {
+            acc->pixels[thread_id] = malloc(EVENT_BATCH * sizeof(unsigned int));
+        }
+        if (partition_heatmaps && acc->tile_bufs[thread_id] == NULL) {
+            acc->tile_bufs[thread_id] = malloc(EVENT_BATCH * sizeof(unsigned int));
+        }
+        EventBatch *batch = acc->batches[thread_id];
+        unsigned int *pixels = acc->pixels[thread_id];
+        unsigned int *tile_buf = acc->tile_bufs[thread_id];
+        if (batch == NULL || ((route_heatmaps || partition_heatmaps) && pixels == NULL) ||
+            (partition_heatmaps && tile_buf == NULL)) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (cursor_open(&cursor, ef, input_filename, opts->reader, bounds[thread_id], bounds[thread_id + 1]) != 0) {
+            printf("Error: Thread %d could not open file %s\n", thread_id, input_filename);
+            cursor.end = cursor.next;  // Keep taking part in the owner rounds with nothing to contribute
+        }
+
+        unsigned int *occurrences_thread = thread_histograms ? occurrences_private + thread_id * MILLIS : NULL;
+        unsigned int *heatmap_thread = private_heatmaps ? data_block_3d + (size_t)thread_id * WIDTH * HEIGHT : data_block_2d;
+        DirtyRange *hist_dirty = thread_histograms ? &acc->hist_dirty[thread_id] : NULL;
+        DirtyRange heat_written = {INT_MAX, 0};  // x columns this thread writes during this file
+        OutOfRange thread_dropped = {0, 0};
+
+        // Each thread zeroes its own partials, so that their pages land on its node when first
+        // touched; afterwards only the rows the previous file wrote are reset
+        double zero_start_time = omp_get_wtime();
+        if (thread_histograms) {
+            clear_dirty_rows(occurrences_thread, 1, hist_dirty);
+        }
+        if (private_heatmaps) {
+            clear_dirty_rows(heatmap_thread, HEIGHT, &acc->heat_dirty[thread_id]);
+        }
+        if (frames != NULL) {
+            clear_frame_partial(frames, thread_id);
+        }
+        trace_span("zero", thread_id, trace.file_idx, zero_start_time, omp_get_wtime(), 0, 0, 0);
+
+        /* Read the part assigned to this thread */
+        for (long round = 0; route_heatmaps ? round < route_rounds : cursor.next < cursor.end; round++) {
+            long expected = cursor.end - cursor.next;
+            if (cursor_next_batch(&cursor, batch) == 0 && expected > 0) {
+                printf("Error: Thread %d hit a short read in %s\n", thread_id, input_filename);
+            }
+            if (filter_window) {
+                filter_batch(batch, (uint64_t)opts->t_start * BIN_US, (uint64_t)opts->t_end * BIN_US);
+            }
+            mark_batch_dirty(batch, hist_dirty, opts->heatmaps ? &heat_written : NULL, &thread_dropped);
+            if (frames != NULL) {
+                accumulate_frames(batch, frames, thread_id);
+            }
+
+            // One pass over the batch feeds every requested output
+            if (route_heatmaps) {
+                int *offsets = acc->route_offsets + thread_id * (num_threads + 1);
+                accumulate_dispatch(batch, occurrences_thread, NULL, thread_histograms, HEAT_UPDATE_NONE);
+                route_batch(batch, acc->x_owner, num_threads, pixels,
+                            acc->route_bufs + (size_t)thread_id * EVENT_BATCH, offsets);
+
+                // Drain the bucket every thread filled for this thread's band
+                #pragma omp barrier
+                for (int src = 0; src < num_threads; src++) {
+                    const unsigned int *bucket = acc->route_bufs + (size_t)src * EVENT_BATCH;
+                    const int *src_offsets = acc->route_offsets + src * (num_threads + 1);
+                    for (int k = src_offsets[thread_id]; k < src_offsets[thread_id + 1]; k++) {
+                        data_block_2d[bucket[k]]++;
+                    }
+                }
+                #pragma omp barrier
+            } else if (partition_heatmaps) {
+                accumulate_dispatch(batch, occurrences_thread, NULL, thread_histograms, HEAT_UPDATE_NONE);
+                partition_batch(batch, heatmap_thread, tile_shift, nb_tiles, pixels, tile_buf);
+            } else {
+                accumulate_dispatch(batch, occurrences_thread, heatmap_thread, thread_histograms, heat_update);
+            }
+        }
+
+        #pragma omp atomic update
+        dropped->late += thread_dropped.late;
+        #pragma omp atomic update
+        dropped->outside += thread_dropped.outside;
+
+        // Remember which columns have to be reset: in the thread's partial, or in the shared heatmap
+        if (private_heatmaps) {
+            dirty_add(&acc->heat_dirty[thread_id], heat_written.lo, heat_written.hi);
+        } else if (opts->heatmaps) {
+            #pragma omp critical
+            dirty_add(heat_dirty, heat_written.lo, heat_written.hi);
+        }
+
+        double end_time = omp_get_wtime();  // End time measurement
+        #ifdef DEBUGGER
+            printf("Thread %d processed its part in %.6f seconds\n", thread_id, end_time - start_time);
+        #endif
+
+        long thread_events = bounds[thread_id + 1] - bounds[thread_id];
+        thread_times[thread_id] = end_time - start_time;
+        trace_span("decode", thread_id, trace.file_idx, start_time, end_time,
+                   thread_events, thread_events * bytes_per_event, 0);
+
+        // Close the file after processing is done
+        cursor_close(&cursor);
+
+    } // End of OpenMP Parallel Processing
+
+    double read_time = omp_get_wtime() - read_start_time;
+    double reduce_start_time = omp_get_wtime();
+
+    // Load imbalance of the region: slowest thread over the mean
+    double max_thread_time = 0.0, sum_thread_time = 0.0;
+    for (int t = 0; t < num_threads; t++) {
+        max_thread_time = thread_times[t] > max_thread_time ? thread_times[t] : max_thread_time;
+        sum_thread_time += thread_times[t];
+    }
+    trace_span("accumulate", 0, trace.file_idx, read_start_time, reduce_start_time, last_event - first_event,
+               (last_event - first_event) * bytes_per_event,
+               sum_thread_time > 0 ? max_thread_time * num_threads / sum_thread_time : 0.0);
+    free(thread_times);
+
+
+    
+    /********************************************************************************************/
+    /*                       CONSOLIDATING DATA FROM OPEN_MP PROCESSES                          */
+    /********************************************************************************************/
+
+
+
+    if (thread_histograms) {
+
+
+        /****************************************************************************************/
+        /*                            OFFLOADING ARRAY OPERATION TO GPU                         */
+        /****************************************************************************************/
+        #ifdef OFFLOADGPU
+        int millis = MILLIS;  // The target regions see a copy, not the host global
+        #pragma omp target data map(to: occurrences_private[0:num_threads * millis]) \
+                            map(from: occurrences[0:millis])
+        {
+            
+            #pragma omp target teams distribute parallel for reduction(+:occurrences[:millis])
+            for (int j = 0; j < millis; j++) {
+                unsigned int sum = 0;
+                for (int i = 0; i < num_threads; i++) {
+                    sum += occurrences_private[i * millis + j];
+                }
+                occurrences[j] = sum;
+            }
+        }
+        #else
+            reduce_partials(occurrences_private, num_threads, MILLIS, occurrences, opts->reduce);
+        #endif // OFFLOADGPU
+
+        #ifdef DEBUGGER
+            for (int j = 0; j < MILLIS; j++) {
+                if(j > MILLIS/num_threads*99/100 && j < MILLIS/num_threads*101/100){
+                    printf("Total occurrences at [ms] %d: %d\n", j, occurrences[j]);
+                }
+            }
+        #endif
+    }
+
+    if (private_heatmaps) {
+        /****************************************************************************************/
+        /*                            OFFLOADING MATRIX OPERATION TO GPU                        */
+        /****************************************************************************************/
+        
+        #ifdef OFFLOADGPU
+        int width = WIDTH, height = HEIGHT;  // Passed to the device by value
+        // Map the data blocks to the GPU
+        #pragma omp target data map(to: data_block_3d[0:num_threads * width * height]) \
+                            map(from: data_block_2d[0:width * height])
+        {
+            // Offload computation to GPU
+            #pragma omp target teams distribute parallel for collapse(2)
+            for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                    unsigned int sum = 0;
+                    for (int i = 0; i < num_threads; i++) {
+                        // Use directly the data block to avoid potential issues with pointer dereferencing
+                        sum += data_block_3d[(i * width * height) + (x * height) + y];
+                    }
+                    data_block_2d[x * height + y] = sum;
+                }
+            }
+        }
+        #else
+            reduce_partials(data_block_3d, num_threads, (size_t)WIDTH * HEIGHT, data_block_2d, opts->reduce);
+        #endif // OFFLOADGPU
+
+    }
+
+    // --frames: sum the threads' copies of the window (zeroed in full before every pass)
+    if (frames != NULL && frames->partials != NULL) {
+        reduce_partials(frames->partials, num_threads, (size_t)frames->count * WIDTH * HEIGHT, frames->stack, opts->reduce);
+    }
+
+
+    #ifndef OFFLOADGPU
+    if (opts->reduce == REDUCE_TREE) {
+        // The tree sums the partials into each other: any of them may now hold any written row
+        widen_dirty_ranges(acc->hist_dirty, thread_histograms ? num_threads : 0);
+        widen_dirty_ranges(acc->heat_dirty, private_heatmaps ? num_threads : 0);
+    }
+    #endif // OFFLOADGPU
+
+
+    /********************************************************************************************/
+    /*                                 FREEING ALLOCATED MEMORY                                 */
+    /********************************************************************************************/
+    // The partials stay allocated for the next file
+    free(bounds);
+
+    *reduce_time = omp_get_wtime() - reduce_start_time;
+    trace_span("reduce", 0, trace.file_idx, reduce_start_time, reduce_start_time + *reduce_time, 0, 0, 0);
+    return read_time;
+}
+
+// --frames: decode events [first_event, last_event) of a file once more for a later window
+double accumulate_frame_window(const Options *opts, const char *input_filename, const EventFile *ef,
+                               long first_event, long last_event, int filter_window, int num_threads,
+                               const FrameWindow *frames) {
+    long *bounds;
+    calculate_event_bounds(num_threads, first_event, last_event,
+                           ef->format == FORMAT_COLUMNAR ? (long)ef->block_events : 1, &bounds);
+    double start_time = omp_get_wtime();
+
+    // The decode buffers are those of accumulate_events(), which ran first with the same threads
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int thread_id = omp_get_thread_num();
+        EventBatch *batch = accumulators.batches[thread_id];
+        EventCursor cursor;
+        if (cursor_open(&cursor, ef, input_filename, opts->reader, bounds[thread_id], bounds[thread_id + 1]) != 0) {
+            printf("Error: Thread %d could not open file %s\n", thread_id, input_filename);
+            cursor.end = cursor.next;
+        }
+        clear_frame_partial(frames, thread_id);
+        while (cursor.next < cursor.end && cursor_next_batch(&cursor, batch) > 0) {
+            if (filter_window) {
+                filter_batch(batch, (uint64_t)opts->t_start * BIN_US, (uint64_t)opts->t_end * BIN_US);
+            }
+            accumulate_frames(batch, frames, thread_id);
+        }
+        cursor_close(&cursor);
+    }
+    if (frames->partials != NULL) {
+        reduce_partials(frames->partials, num_threads, (size_t)frames->count * WIDTH * HEIGHT, frames->stack, opts->reduce);
+    }
+
+    double end_time = omp_get_wtime();
+    trace_span("frames", 0, trace.file_idx, start_time, end_time, last_event - first_event, 0, 0);
+    free(bounds);
+    return end_time - start_time;
+}
+
+// Scene of a file: its base name up to the last '_' ("scene1_c" belongs to "scene1"), or the
+// whole base name when it has none
+void scene_name(const char *file_name, char *scene) {
+    get_base_name(file_name, scene);
+    char *separator = strrchr(scene, '_');
+    if (separator != NULL && separator != scene) {
+        *separator = '\0';
+    }
+}
+
+// Assign files [first_file, nb_files) to their aggregate groups, adding the scenes not seen yet
+// (in manifest order, so that every rank builds the same groups)
+void aggregate_add_files(Aggregate *agg, const Options *opts, const FileList *file_list, int first_file) {
+    if (agg->nb_groups == 0) {
+        agg->group_size = (opts->histograms ? MILLIS : 0) + (opts->heatmaps ? (size_t)WIDTH * HEIGHT : 0);
+        agg->nb_groups = 1;
+        agg->group_names = malloc(sizeof(char *));
+        agg->totals = calloc(agg->group_size, sizeof(unsigned int));
+        agg->reduced = malloc(agg->group_size * sizeof(unsigned int));
+        if (agg->group_names == NULL || agg->totals == NULL || agg->reduced == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        agg->group_names[0] = strdup("all");
+    }
+
+    agg->file_group = realloc(agg->file_group, (file_list->nb_files > 0 ? file_list->nb_files : 1) * sizeof(int));
+    if (agg->file_group == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = first_file; i < file_list->nb_files; i++) {
+        agg->file_group[i] = 0;
+        if (opts->aggregate != AGGREGATE_SCENES) {
+            continue;
+        }
+
+        char scene[MAX_FILENAME_LENGTH];
+        scene_name(file_list_name(file_list, i), scene);
+        int group = 1;
+        while (group < agg->nb_groups && strcmp(agg->group_names[group], scene) != 0) {
+            group++;
+        }
+        if (group == agg->nb_groups) {
+            if ((size_t)(group + 1) * agg->group_size > INT_MAX) {
+                printf("Error: Too many scenes to aggregate, %s is counted in the total only\n", scene);
+                group = 0;
+            } else {
+                agg->nb_groups++;
+                agg->group_names = realloc(agg->group_names, agg->nb_groups * sizeof(char *));
+                agg->totals = realloc(agg->totals, agg->nb_groups * agg->group_size * sizeof(unsigned int));
+                agg->reduced = realloc(agg->reduced, agg->nb_groups * agg->group_size * sizeof(unsigned int));
+                if (agg->group_names == NULL || agg->totals == NULL || agg->reduced == NULL) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+                agg->group_names[group] = strdup(scene);
+                memset(agg->totals + group * agg->group_size, 0, agg->group_size * sizeof(unsigned int));
+            }
+        }
+        agg->file_group[i] = group;
+    }
+}
+
+// Add a complete result (on its owner) to the running totals of the dataset and of its scene
+void aggregate_add(Aggregate *agg, const FileResult *result, const Options *opts) {
+    int groups[2] = {0, agg->file_group[result->file_idx]};
+    for (int g = 0; g < (groups[1] != 0 ? 2 : 1); g++) {
+        unsigned int *restrict total = agg->totals + groups[g] * agg->group_size;
+        if (opts->histograms) {
+            #pragma omp simd
+            for (int k = 0; k < MILLIS; k++) {
+                total[k] += result->occurrences[k];
+            }
+            total += MILLIS;
+        }
+        if (opts->heatmaps) {
+            const unsigned int *restrict heat = result->data_block_2d;
+            #pragma omp simd
+            for (int k = 0; k < WIDTH * HEIGHT; k++) {
+                total[k] += heat[k];
+            }
+        }
+    }
+}
+
+// Start summing every rank's totals at rank 0. Called once a rank holds no more results, so that
+// the reduction runs while it writes its last outputs and the other ranks finish their files.
+void aggregate_start(Aggregate *agg, int rank) {
+    MPI_Ireduce(agg->totals, rank == 0 ? agg->reduced : NULL, (int)(agg->nb_groups * agg->group_size),
+                MPI_UNSIGNED, MPI_SUM, 0, MPI_COMM_WORLD, &agg->request);
+}
+
+// Wait for the reduction; rank 0 writes aggregate/occ_<group>.bin and aggregate/map_<group>.bin
+// for the whole dataset ("all") and every scene ("all_<scene>"). They get their own directory so
+// that the per-file outputs of a recording named all.bin or all_<scene>.bin cannot overwrite them.
+int aggregate_finish(Aggregate *agg, const Options *opts, int rank) {
+    double start = omp_get_wtime();
+    MPI_Wait(&agg->request, MPI_STATUS_IGNORE);
+    trace_span("aggregate", 0, -1, start, omp_get_wtime(), 0, 0, 0);
+    if (rank != 0) {
+        return 0;
+    }
+
+    if (mkdir("aggregate", 0755) != 0 && errno != EEXIST) {
+        printf("Error: Could not create directory aggregate\n");
         return 1;
     }
 
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--folder") == 0 && i + 1 < argc) {
-            *folder_path = argv[i + 1];
-            return 0;
+    int rc = 0;
+    for (int g = 0; g < agg->nb_groups; g++) {
+        const unsigned int *total = agg->reduced + g * agg->group_size;
+        char name[MAX_FILENAME_LENGTH + 16];
+        const char *prefix = (g == 0) ? "" : "all_";
+        if (opts->histograms) {
+            snprintf(name, sizeof(name), "aggregate/occ_%s%s.bin", prefix, agg->group_names[g]);
+            rc |= write_output(name, total, MILLIS);
+            total += MILLIS;
+        }
+        if (opts->heatmaps) {
+            snprintf(name, sizeof(name), "aggregate/map_%s%s.bin", prefix, agg->group_names[g]);
+            rc |= write_output(name, total, (size_t)WIDTH * HEIGHT);
         }
     }
+    return rc;
+}
 
-    printf("Error: Folder path not specified.\n");
-    return 1;
+void free_aggregate(Aggregate *agg) {
+    for (int g = 0; g < agg->nb_groups; g++) {
+        free(agg->group_names[g]);
+    }
+    free(agg->group_names);
+    free(agg->file_group);
+    free(agg->totals);
+    free(agg->reduced);
+    memset(agg, 0, sizeof(*agg));
 }
 
-int scan_directory(const char *folder_path, FileList *file_list) {
+// Released results, reused by the next files instead of allocating and faulting in new buffers
+// (the background writer releases them too)
+static FileResult *result_pool;
+static pthread_mutex_t result_pool_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    DIR *dir;
-    struct dirent *entry;
-    int count = 0;
+FileResult *new_file_result(const Options *opts, const char *base_name) {
+    pthread_mutex_lock(&result_pool_lock);
+    FileResult *result = result_pool;
+    if (result != NULL) {
+        result_pool = result->next_free;
+    }
+    pthread_mutex_unlock(&result_pool_lock);
 
-    dir = opendir(folder_path);
-    if (dir == NULL) {
-        perror("opendir");
-        return -1;
+    if (result != NULL) {
+        // The histogram is always written as a whole; the heatmap only has its dirty columns reset
+        result->nb_requests = 0;
+        result->next_free = NULL;
+        if (result->data_block_2d != NULL) {
+            clear_dirty_rows(result->data_block_2d, HEIGHT, &result->heat_dirty);
+        }
+    } else {
+        result = calloc(1, sizeof(FileResult));
+        if (result == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        result->heat_dirty = (DirtyRange){INT_MAX, 0};
+
+        result->occurrences = calloc(MILLIS, sizeof(unsigned int));
+        if (result->occurrences == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (opts->heatmaps) {
+            result->data_block_2d = calloc(WIDTH * HEIGHT, sizeof(unsigned int));
+            if (result->data_block_2d == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
-    strncpy(file_list->folder_name, folder_path, MAX_FOLDER_LENGTH - 1);
+    snprintf(result->hist_filename, sizeof(result->hist_filename), "histograms/occ_%s.bin", base_name);
+    result->compress_heatmap = (opts->heat_format == HEAT_FORMAT_AUTO);
+    snprintf(result->heat_filename, sizeof(result->heat_filename), "heatmaps/map_%s.%s", base_name,
+             result->compress_heatmap ? "hmz" : "bin");
+    return result;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) {  // Regular file
-            if (count < MAX_FILES) {
-                strncpy(file_list->file_names[count], entry->d_name, MAX_FILENAME_LENGTH - 1);
-                file_list->file_names[count][MAX_FILENAME_LENGTH - 1] = '\0';  // Ensure null-termination
-                count++;
-            } else {
-                printf("Warning: Maximum number of files exceeded.\n");
-                break;
+void release_file_result(FileResult *result) {
+    pthread_mutex_lock(&result_pool_lock);
+    result->next_free = result_pool;
+    result_pool = result;
+    pthread_mutex_unlock(&result_pool_lock);
+}
+
+void free_result_pool(void) {
+    while (result_pool != NULL) {
+        FileResult *next = result_pool->next_free;
+        free(result_pool->occurrences);
+        free(result_pool->data_block_2d);
+        free(result_pool);
+        result_pool = next;
+    }
+}
+
+// Start summing the partial results of every rank into the owner's buffers
+void reduce_file_result(FileResult *result, const Options *opts, int rank) {
+    int is_owner = (result->owner == rank);
+    int root = result->owner;
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    result->nb_requests = 0;
+    if (shm.enabled) {
+        // The node totals are summed between the node leaders only
+        if (shm.node_rank != 0) {
+            return;
+        }
+        root = result->file_idx % shm.nb_nodes;
+        comm = shm.leader_comm;
+    }
+    if (opts->histograms) {
+        MPI_Ireduce(is_owner ? MPI_IN_PLACE : result->occurrences, result->occurrences, MILLIS,
+                    MPI_UNSIGNED, MPI_SUM, root, comm, &result->requests[result->nb_requests++]);
+    }
+    if (opts->heatmaps) {
+        if (is_owner && heat_accum_shared(opts->heat_accum)) {
+            result->heat_dirty = (DirtyRange){0, WIDTH};  // Every rank may add to any column
+        }
+        MPI_Ireduce(is_owner ? MPI_IN_PLACE : result->data_block_2d, result->data_block_2d, WIDTH * HEIGHT,
+                    MPI_UNSIGNED, MPI_SUM, root, comm, &result->requests[result->nb_requests++]);
+    }
+}
+
+// --heat-format auto: write a heatmap in its smallest .hmz encoding
+int write_heatmap_compressed(const char *output_filename, const unsigned int *data, size_t *bytes) {
+    size_t pixels = (size_t)WIDTH * HEIGHT;
+
+    // Non-zero pixels and pixels above uint8/uint16 decide the encoding
+    size_t nonzero = 0, over8 = 0, over16 = 0;
+    #pragma omp simd reduction(+:nonzero, over8, over16)
+    for (size_t i = 0; i < pixels; i++) {
+        nonzero += (data[i] != 0);
+        over8 += (data[i] > UINT8_MAX);
+        over16 += (data[i] > UINT16_MAX);
+    }
+
+    size_t entry_bytes = 2 * sizeof(uint32_t);
+    size_t sizes[] = {nonzero * entry_bytes, pixels * sizeof(uint8_t) + over8 * entry_bytes,
+                      pixels * sizeof(uint16_t) + over16 * entry_bytes, pixels * sizeof(uint32_t)};
+    size_t entries[] = {nonzero, over8, over16, 0};
+    HeatmapEncoding encoding = HEATMAP_SPARSE;
+    for (int e = HEATMAP_DENSE8; e <= HEATMAP_DENSE32; e++) {
+        if (sizes[e] < sizes[encoding]) {
+            encoding = (HeatmapEncoding)e;
+        }
+    }
+
+    HeatmapHeader header = {0};
+    memcpy(header.magic, HEATMAP_MAGIC, 4);
+    header.version = HEATMAP_VERSION;
+    header.width = WIDTH;
+    header.height = HEIGHT;
+    header.encoding = encoding;
+    header.nb_entries = entries[encoding];
+    size_t table_bytes = header.nb_entries * entry_bytes;
+    size_t dense_bytes = sizes[encoding] - table_bytes;
+
+    // The narrow counters and the index/count table are built in separate buffers: the table
+    // follows an odd number of narrow counters on odd sensors, so it is not aligned in the file
+    int narrow = (encoding == HEATMAP_DENSE8 || encoding == HEATMAP_DENSE16);
+    unsigned char *dense = narrow ? malloc(dense_bytes) : NULL;
+    uint32_t *table = (encoding != HEATMAP_DENSE32) ? malloc(table_bytes > 0 ? table_bytes : 1) : NULL;
+    if ((narrow && dense == NULL) || (encoding != HEATMAP_DENSE32 && table == NULL)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Pixels listed in the table: all non-zero ones, or those above the narrow counters
+    unsigned int listed_above = 0;
+    if (encoding == HEATMAP_DENSE8) {
+        #pragma omp simd
+        for (size_t i = 0; i < pixels; i++) {
+            dense[i] = (uint8_t)(data[i] > UINT8_MAX ? UINT8_MAX : data[i]);
+        }
+        listed_above = UINT8_MAX;
+    } else if (encoding == HEATMAP_DENSE16) {
+        uint16_t *dense16 = (uint16_t *)dense;
+        #pragma omp simd
+        for (size_t i = 0; i < pixels; i++) {
+            dense16[i] = (uint16_t)(data[i] > UINT16_MAX ? UINT16_MAX : data[i]);
+        }
+        listed_above = UINT16_MAX;
+    }
+    if (table != NULL) {
+        uint32_t *indices = table;
+        uint32_t *counts = table + header.nb_entries;
+        size_t k = 0;
+        for (size_t i = 0; i < pixels && k < header.nb_entries; i++) {
+            if (data[i] > listed_above) {
+                indices[k] = (uint32_t)i;
+                counts[k++] = data[i];
             }
         }
     }
 
-    closedir(dir);
-    file_list->nb_files = count;
+    FILE *output_file = fopen(output_filename, "wb");
+    if (!output_file) {
+        printf("Error: Could not create output file %s\n", output_filename);
+        free(dense);
+        free(table);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, output_file);
+    if (encoding == HEATMAP_DENSE32) {
+        fwrite(data, sizeof(unsigned int), pixels, output_file);
+    } else {
+        if (dense != NULL) {
+            fwrite(dense, 1, dense_bytes, output_file);
+        }
+        fwrite(table, 1, table_bytes, output_file);
+    }
+    fclose(output_file);
+    free(dense);
+    free(table);
+
+    *bytes = sizeof(header) + sizes[encoding];
+    printf("Data saved to %s (%s, %.1f%% of dense)\n", output_filename, heatmap_encoding_names[header.encoding],
+           100.0 * (double)*bytes / (double)sizes[HEATMAP_DENSE32]);
     return 0;
 }
 
-// Function implementations
-void get_base_name(const char *input_filename, char *base_name) {
-    const char *last_slash = strrchr(input_filename, '/');
-    const char *dot = strrchr(input_filename, '.');
-    
-    if (last_slash == NULL) {
-        last_slash = input_filename - 1;
+// --hist-levels: every coarser histogram is summed from the finest one it is a multiple of (the
+// base histogram at worst) and written as occ_<base>_x<factor>.bin
+int write_histogram_levels(const FileResult *result, const Options *opts) {
+    size_t total = 0;
+    for (int l = 0; l < opts->nb_hist_levels; l++) {
+        total += (MILLIS + opts->hist_levels[l] - 1) / opts->hist_levels[l];
     }
-    if (dot == NULL || dot < last_slash) {
-        dot = input_filename + strlen(input_filename);
+    unsigned int *levels = malloc(total * sizeof(unsigned int));
+    const unsigned int **sources = malloc(opts->nb_hist_levels * sizeof(unsigned int *));
+    if (levels == NULL || sources == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
     }
-    
-    strncpy(base_name, last_slash + 1, dot - last_slash - 1);
-    base_name[dot - last_slash - 1] = '\0';
+
+    int rc = 0;
+    unsigned int *level = levels;
+    size_t stem = strlen(result->hist_filename) - strlen(".bin");
+    for (int l = 0; l < opts->nb_hist_levels; l++) {
+        int factor = opts->hist_levels[l];
+        const unsigned int *fine = result->occurrences;
+        int fine_factor = 1;
+        for (int k = 0; k < l; k++) {
+            if (factor % opts->hist_levels[k] == 0 && opts->hist_levels[k] > fine_factor) {
+                fine = sources[k];
+                fine_factor = opts->hist_levels[k];
+            }
+        }
+
+        int step = factor / fine_factor;
+        int fine_bins = (MILLIS + fine_factor - 1) / fine_factor;
+        int bins = (MILLIS + factor - 1) / factor;
+        for (int b = 0; b < bins; b++) {
+            unsigned int sum = 0;
+            int end = (b + 1) * step < fine_bins ? (b + 1) * step : fine_bins;
+            for (int f = b * step; f < end; f++) {
+                sum += fine[f];
+            }
+            level[b] = sum;
+        }
+        sources[l] = level;
+
+        char level_filename[MAX_FILENAME_LENGTH + 16];
+        snprintf(level_filename, sizeof(level_filename), "%.*s_x%d.bin", (int)stem, result->hist_filename, factor);
+        rc |= write_output(level_filename, level, bins);
+        level += bins;
+    }
+
+    free(sources);
+    free(levels);
+    return rc;
 }
 
+// Write the requested outputs of a result and release it
+int write_file_result(FileResult *result, const Options *opts) {
+    double start = omp_get_wtime();
+    int rc = 0;
+    int histograms = opts->histograms;
+    int heatmaps = opts->heatmaps;
 
-void calculate_start_positions(int num_threads, unsigned int total_events, long **start_positions) {
-    *start_positions = malloc((num_threads + 1) * sizeof(long));
-    if (!*start_positions) {
-        printf("Error: Memory allocation failed.\n");
+    if (histograms && write_output(result->hist_filename, result->occurrences, MILLIS) != 0) {
+        rc = 1;
+    }
+    if (histograms && opts->nb_hist_levels > 0) {
+        rc |= write_histogram_levels(result, opts);
+    }
+    size_t heat_bytes = WIDTH * HEIGHT * sizeof(unsigned int);
+    if (heatmaps && result->compress_heatmap) {
+        rc |= write_heatmap_compressed(result->heat_filename, result->data_block_2d, &heat_bytes);
+    } else if (heatmaps && write_output(result->heat_filename, result->data_block_2d, WIDTH * HEIGHT) != 0) {
+        rc = 1;
+    }
+    if (histograms || heatmaps) {
+        trace_span("write", trace_tid, result->file_idx, start, omp_get_wtime(), 0,
+                   (histograms ? MILLIS * sizeof(unsigned int) : 0) + (heatmaps ? heat_bytes : 0), 0);
+    }
+
+    release_file_result(result);
+    return rc;
+}
+
+// --container: create (or truncate) the container; collective
+int container_open(Container *c, const char *path, const Options *opts) {
+    c->hist_bytes = opts->histograms ? MILLIS * sizeof(unsigned int) : 0;
+    c->heat_bytes = opts->heatmaps ? (size_t)WIDTH * HEIGHT * sizeof(unsigned int) : 0;
+    c->staged = NULL;
+    c->nb_staged = 0;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &c->fh) != MPI_SUCCESS ||
+        MPI_File_set_size(c->fh, 0) != MPI_SUCCESS) {
+        printf("Error: Could not create container %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// Keep an owned result until the next round writes it
+void container_stage(Container *c, FileResult *result) {
+    result->next_free = c->staged;
+    c->staged = result;
+    c->nb_staged++;
+}
+
+// One collective round: every rank writes the results it finished since the last round at their
+// precomputed offsets (ranks with fewer take part with empty writes). Returns whether any rank
+// is still active, or -1 on a write error.
+int container_round(Container *c, int active) {
+    double start = omp_get_wtime();
+    int counts[2] = {active, c->nb_staged};
+    MPI_Allreduce(MPI_IN_PLACE, counts, 2, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    int rc = 0;
+    size_t record_bytes = c->hist_bytes + c->heat_bytes;
+    for (int k = 0; k < counts[1]; k++) {
+        FileResult *result = c->staged;
+        MPI_Offset offset = 0;
+        if (result != NULL) {
+            c->staged = result->next_free;
+            c->nb_staged--;
+            offset = CONTAINER_DATA_OFFSET + (MPI_Offset)result->file_idx * record_bytes;
+        }
+        if (c->hist_bytes > 0) {
+            rc |= MPI_File_write_at_all(c->fh, offset, result ? result->occurrences : NULL, result ? MILLIS : 0,
+                                        MPI_UNSIGNED, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+        }
+        if (c->heat_bytes > 0) {
+            rc |= MPI_File_write_at_all(c->fh, offset + c->hist_bytes, result ? result->data_block_2d : NULL,
+                                        result ? WIDTH * HEIGHT : 0, MPI_UNSIGNED, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+        }
+        if (result != NULL) {
+            release_file_result(result);
+        }
+    }
+    if (counts[1] > 0) {
+        trace_span("container", 0, -1, start, omp_get_wtime(), 0, 0, 0);
+    }
+    if (rc != 0) {
+        printf("Error: Could not write to the container\n");
+        return -1;
+    }
+    return counts[0];
+}
+
+// Rank 0 writes the index of files [0, nb_files) after their records and points the header at it;
+// the data is then flushed to storage (collective)
+int container_write_index(Container *c, const FileList *file_list, const Options *opts, int rank) {
+    int rc = 0;
+    if (rank == 0) {
+        uint64_t n = (uint64_t)file_list->nb_files;
+        ContainerHeader header = {0};
+        memcpy(header.magic, CONTAINER_MAGIC, 4);
+        header.version = CONTAINER_VERSION;
+        header.nb_files = n;
+        header.data_offset = CONTAINER_DATA_OFFSET;
+        header.record_bytes = c->hist_bytes + c->heat_bytes;
+        header.index_offset = header.data_offset + n * header.record_bytes;
+        header.millis = MILLIS;
+        header.width = WIDTH;
+        header.height = HEIGHT;
+        header.outputs = (opts->histograms ? 1 : 0) | (opts->heatmaps ? 2 : 0);
+
+        // Entries, then the names
+        size_t entries_bytes = n * sizeof(ContainerEntry);
+        unsigned char *index = malloc(entries_bytes + file_list->names_bytes + 1);
+        if (index == NULL) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        size_t names_bytes = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            char base_name[MAX_FILENAME_LENGTH];
+            get_base_name(file_list_name(file_list, (int)i), base_name);
+            size_t length = strlen(base_name);
+            ContainerEntry entry = {header.data_offset + i * header.record_bytes, (uint32_t)names_bytes, (uint32_t)length};
+            memcpy(index + i * sizeof(ContainerEntry), &entry, sizeof(entry));
+            memcpy(index + entries_bytes + names_bytes, base_name, length + 1);
+            names_bytes += length + 1;
+        }
+
+        rc |= MPI_File_write_at(c->fh, (MPI_Offset)header.index_offset, index, (int)(entries_bytes + names_bytes),
+                                MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+        rc |= MPI_File_write_at(c->fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+        free(index);
+        if (rc != 0) {
+            printf("Error: Could not write the container index\n");
+        } else {
+            printf("Container: %" PRIu64 " file(s), %.2f MB\n", n,
+                   (header.index_offset + entries_bytes + names_bytes) / (1024.0 * 1024.0));
+        }
+    }
+    MPI_File_sync(c->fh);
+    MPI_Bcast(&rc, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    return rc;
+}
+
+static void *writer_main(void *arg) {
+    Writer *w = (Writer *)arg;
+    trace_tid = TRACE_TID_WRITER;
+    w->status = write_file_result(w->result, w->opts);
+    return NULL;
+}
+
+// Wait for the write in flight (if any); returns its status
+int writer_wait(Writer *w) {
+    if (!w->active) {
+        return 0;
+    }
+    pthread_join(w->thread, NULL);
+    w->active = 0;
+    return w->status;
+}
+
+// Hand a result over to the background writer (after the previous write completed)
+int writer_submit(Writer *w, FileResult *result, const Options *opts) {
+    int rc = writer_wait(w);
+
+    w->result = result;
+    w->opts = opts;
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        return write_file_result(result, opts) || rc;
+    }
+    w->active = 1;
+    return rc;
+}
+
+// Wait for any pending reduction, let the owner write the outputs (in the background when a
+// writer is given, at the next container round with --container) and release the result
+int finish_file_result(FileResult *result, const Options *opts, int rank, Writer *writer) {
+    if (result->nb_requests > 0) {
+        double start = omp_get_wtime();
+        MPI_Waitall(result->nb_requests, result->requests, MPI_STATUSES_IGNORE);
+        trace_span("mpi_reduce", 0, result->file_idx, start, omp_get_wtime(), 0, 0, 0);
+    }
+
+    if (result->owner != rank) {
+        release_file_result(result);
+        return 0;
+    }
+    if (opts->aggregate != AGGREGATE_NONE) {
+        aggregate_add(&aggregate, result, opts);
+    }
+    if (opts->container_path != NULL) {
+        container_stage(&container, result);
+        return 0;
+    }
+    if (writer != NULL) {
+        return writer_submit(writer, result, opts);
+    }
+    return write_file_result(result, opts);
+}
+
+// --shm: group the ranks by node, and give each of them a slot of a window shared within the node
+void shm_init(NodeShm *s, int rank) {
+    s->enabled = 1;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &s->node_comm);
+    MPI_Comm_rank(s->node_comm, &s->node_rank);
+    MPI_Comm_size(s->node_comm, &s->node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, s->node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &s->leader_comm);
+    if (s->node_rank == 0) {
+        MPI_Comm_rank(s->leader_comm, &s->node_index);
+        MPI_Comm_size(s->leader_comm, &s->nb_nodes);
+    }
+    MPI_Bcast(&s->node_index, 1, MPI_INT, 0, s->node_comm);
+    MPI_Bcast(&s->nb_nodes, 1, MPI_INT, 0, s->node_comm);
+
+    s->leader_ranks = malloc(s->nb_nodes * sizeof(int));
+    s->slots = malloc(s->node_size * sizeof(unsigned int *));
+    if (s->leader_ranks == NULL || s->slots == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
+    if (s->node_rank == 0) {
+        MPI_Allgather(&rank, 1, MPI_INT, s->leader_ranks, 1, MPI_INT, s->leader_comm);
+    }
+    MPI_Bcast(s->leader_ranks, s->nb_nodes, MPI_INT, 0, s->node_comm);
 
-    int events_per_thread = total_events / num_threads;
-    if (total_events % num_threads != 0) {
-        events_per_thread++;
+    // Non-contiguous: every slot starts on its own pages, which its rank touches first
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    size_t slot_bytes = (size_t)(MILLIS + WIDTH * HEIGHT) * sizeof(unsigned int);
+    unsigned int *own_slot;
+    MPI_Win_allocate_shared((MPI_Aint)slot_bytes, sizeof(unsigned int), info, s->node_comm, &own_slot, &s->win);
+    MPI_Info_free(&info);
+    memset(own_slot, 0, slot_bytes);
+    s->slot_dirty = (DirtyRange){INT_MAX, 0};
+
+    for (int r = 0; r < s->node_size; r++) {
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(s->win, r, &size, &disp_unit, &s->slots[r]);
     }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, s->win);  // Kept open for MPI_Win_sync
+    MPI_Barrier(s->node_comm);
+}
 
-    (*start_positions)[0] = sizeof(unsigned int);
-    for (int i = 1; i <= num_threads; i++) {
-        (*start_positions)[i] = (*start_positions)[i - 1] + events_per_thread * EVENT_SIZE_BYTES;
-        if ((*start_positions)[i] > sizeof(unsigned int) + total_events * EVENT_SIZE_BYTES) {
-            (*start_positions)[i] = sizeof(unsigned int) + total_events * EVENT_SIZE_BYTES;
+void shm_free(NodeShm *s) {
+    if (!s->enabled) {
+        return;
+    }
+    MPI_Win_unlock_all(s->win);
+    MPI_Win_free(&s->win);
+    if (s->leader_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&s->leader_comm);
+    }
+    MPI_Comm_free(&s->node_comm);
+    free(s->leader_ranks);
+    free(s->slots);
+    s->enabled = 0;
+}
+
+// --shm: sum the slots of the node into the first one, every rank adding up its own slice of the
+// counters, and give the node total to the leader's result. Collective over the node.
+void shm_reduce(NodeShm *s, FileResult *result, const Options *opts) {
+    double start = omp_get_wtime();
+    long lo = opts->histograms ? 0 : MILLIS;
+    long hi = opts->heatmaps ? MILLIS + WIDTH * HEIGHT : MILLIS;
+    long begin = split_bound(lo, hi, s->node_rank, s->node_size, 16);
+    long end = split_bound(lo, hi, s->node_rank + 1, s->node_size, 16);
+    unsigned int *total = s->slots[0];
+
+    MPI_Win_sync(s->win);
+    MPI_Barrier(s->node_comm);  // Every slot holds its rank's part
+    MPI_Win_sync(s->win);
+
+    #pragma omp parallel for schedule(static) if ((end - begin) * s->node_size >= REDUCE_PARALLEL_MIN)
+    for (long tile = begin; tile < end; tile += REDUCE_TILE) {
+        long len = (end - tile < REDUCE_TILE) ? end - tile : REDUCE_TILE;
+        unsigned int *restrict dst = total + tile;
+        for (int r = 1; r < s->node_size; r++) {
+            const unsigned int *restrict src = s->slots[r] + tile;
+            #pragma omp simd
+            for (long k = 0; k < len; k++) {
+                dst[k] += src[k];
+            }
+        }
+    }
+
+    MPI_Win_sync(s->win);
+    MPI_Barrier(s->node_comm);  // The first slot holds the node total
+    MPI_Win_sync(s->win);
+
+    if (s->node_rank == 0) {
+        if (opts->histograms) {
+            memcpy(result->occurrences, total, MILLIS * sizeof(unsigned int));
+        }
+        if (opts->heatmaps) {
+            memcpy(result->data_block_2d, total + MILLIS, (size_t)WIDTH * HEIGHT * sizeof(unsigned int));
+            if (heat_accum_shared(opts->heat_accum)) {
+                s->slot_dirty = (DirtyRange){0, WIDTH};  // The other ranks added to any column
+            }
+        }
+    }
+    trace_span("node_reduce", 0, result->file_idx, start, omp_get_wtime(), 0, 0, 0);
+}
+
+// Rank writing the outputs of a file: the rank itself (or its node leader with --shm), or in split
+// mode the rank (or node leader) the file is dealt to
+int file_owner(const Options *opts, int file_idx, int rank, int num_tasks) {
+    if (opts->schedule == SCHEDULE_SPLIT) {
+        return shm.enabled ? shm.leader_ranks[file_idx % shm.nb_nodes] : file_idx % num_tasks;
+    }
+    return shm.enabled ? shm.leader_ranks[shm.node_index] : rank;
+}
+
+// --frames: number of frames of a recording, how many of them one window holds, and whether every
+// thread gets its own copy of the window. The copies save one atomic increment per event on the
+// shared stack (contended when events cluster in a few pixels), but are only used when they and
+// the stack hold all the frames within --frame-memory, so that they never cost an extra pass.
+static void frame_layout(const Options *opts, int num_threads, int *nb_frames, int *capacity, int *per_thread) {
+    size_t frame_bytes = (size_t)WIDTH * HEIGHT * sizeof(unsigned int);
+    size_t fit = (size_t)opts->frame_memory_mb * 1024 * 1024 / frame_bytes;
+    *nb_frames = (MILLIS + opts->frame_bins - 1) / opts->frame_bins;
+    *capacity = fit < (size_t)*nb_frames ? (int)fit : *nb_frames;
+    *per_thread = num_threads > 1 && (size_t)*nb_frames * (num_threads + 1) <= fit;
+}
+
+// --frames: sum the frames of the current window at the file's owner, which appends them to
+// heatmaps/frames_<base>.bin ([frame][x][y] uint32)
+int finish_frame_window(const Options *opts, const FrameWindow *frames, const char *base_name,
+                        int owner, int file_idx, int rank) {
+    int count = frames->count * WIDTH * HEIGHT;
+    if (shm.enabled) {
+        MPI_Reduce(shm.node_rank == 0 ? MPI_IN_PLACE : frames->stack, frames->stack, count,
+                   MPI_UNSIGNED, MPI_SUM, 0, shm.node_comm);
+        if (opts->schedule == SCHEDULE_SPLIT && shm.node_rank == 0) {
+            int root = file_idx % shm.nb_nodes;
+            MPI_Reduce(shm.node_index == root ? MPI_IN_PLACE : frames->stack, frames->stack, count,
+                       MPI_UNSIGNED, MPI_SUM, root, shm.leader_comm);
         }
+    } else if (opts->schedule == SCHEDULE_SPLIT) {
+        MPI_Reduce(owner == rank ? MPI_IN_PLACE : frames->stack, frames->stack, count,
+                   MPI_UNSIGNED, MPI_SUM, owner, MPI_COMM_WORLD);
+    }
+    if (owner != rank) {
+        return 0;
+    }
+
+    char filename[MAX_FILENAME_LENGTH];
+    snprintf(filename, sizeof(filename), "heatmaps/frames_%s.bin", base_name);
+    FILE *output_file = fopen(filename, frames->first == 0 ? "wb" : "ab");
+    if (!output_file) {
+        printf("Error: Could not create output file %s\n", filename);
+        return 1;
+    }
+    fwrite(frames->stack, sizeof(unsigned int), (size_t)count, output_file);
+    fclose(output_file);
+    printf("Data saved to %s (frames %d to %d)\n", filename, frames->first, frames->first + frames->count);
+    return 0;
+}
+
+// Bring the whole file into memory so the compute threads never wait on storage
+static void *prefetcher_main(void *arg) {
+    Prefetcher *pf = (Prefetcher *)arg;
+    double start = omp_get_wtime();
+
+    pf->status = open_event_file(pf->input_filename, pf->reader, &pf->ef);
+    if (pf->status != 0) {
+        return NULL;
+    }
+
+    // Fault every page in now (the mapping is then handed to the compute threads as is), or
+    // stream the file once so that the threads' freads are served from the page cache
+    if (numa.interleave_input) {
+        warm_interleaved(&numa, pf->input_filename, &pf->ef.mapped);
+    } else {
+        warm_file(pf->input_filename, &pf->ef.mapped);
+    }
+    trace_span("prefetch", TRACE_TID_PREFETCHER, pf->file_idx, start, omp_get_wtime(),
+               pf->ef.total_events, pf->ef.file_size, 0);
+    return NULL;
+}
+
+void prefetcher_start(Prefetcher *pf, const char *input_filename, int file_idx, ReaderMode reader) {
+    pf->file_idx = file_idx;
+    strncpy(pf->input_filename, input_filename, sizeof(pf->input_filename) - 1);
+    pf->input_filename[sizeof(pf->input_filename) - 1] = '\0';
+    pf->reader = reader;
+    pf->active = (pthread_create(&pf->thread, NULL, prefetcher_main, pf) == 0);
+    if (!pf->active) {
+        prefetcher_main(pf);  // No thread available: load synchronously
+    }
+}
+
+// Collect the prefetched file; the same contract as open_event_file()
+int prefetcher_wait(Prefetcher *pf, EventFile *ef) {
+    if (pf->active) {
+        pthread_join(pf->thread, NULL);
+        pf->active = 0;
     }
+    *ef = pf->ef;
+    return pf->status;
 }
 
 // Function to find the file indices corresponding to a given rank
@@ -132,83 +3597,128 @@ int* files_for_rank(int numfiles, int num_tasks, int rank, int* num_files_for_ra
     int idx = 0;
     for (int i = 0; i < numfiles; i++) {
         if (i % num_tasks == rank) {
-            file_indices[idx++] = i;
-        }
-    }
-
-    return file_indices;
-}
-
-int main(int argc, char *argv[]) {
-
-    const char *folder_path = NULL;
-    FileList file_list = {0};  // Initialize with zero files
-    
-    int num_tasks, rank, rc;
-    double mpi_start_time, mpi_end_time, mpi_elapsed_time, mpi_max_elapsed_time;
-
-    #ifdef HISTOGRAMS
-        printf("This program creates Histograms\n");
-    #endif
-
-    #ifdef HEATMAPS
-        printf("This program creates Heatmaps\n");
-    #endif
-
-    
-    // Initialize MPI
-    rc = MPI_Init(&argc, &argv);
-    if (rc != MPI_SUCCESS) {
-        printf("Error starting MPI program. Terminating.\n");
-        MPI_Abort(MPI_COMM_WORLD, rc);
-    }
-
-    // Record the start time
-    mpi_start_time = MPI_Wtime();
-
-    // Get the number of MPI tasks and the rank of this process
-    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
-    printf("Available MPI tasks: %d\n", num_tasks);
-
-    /********************************************************************************************/
-    /*           PARSING ARGUMENTS, SETTING OUTPUT FILE NAMES, OPENING INPUT FILE, ETC          */
-    /********************************************************************************************/
+            file_indices[idx++] = i;
+        }
+    }
 
+    return file_indices;
+}
 
-    int num_threads = 1;
-    num_threads = omp_get_max_threads();  // Use maximum number of threads allowed by OpenMP runtime
-    printf("Available OpenMP Threads: %d\n", num_threads);
+// Hand out files [first_file, nb_files)
+void scheduler_init(FileScheduler *s, ScheduleMode mode, int first_file, int nb_files, int num_tasks, int rank) {
+    s->mode = mode;
+    s->nb_files = nb_files;
+    s->next = 0;
+    s->wait_time = 0.0;
+    s->file_idxs = NULL;
+    s->counter = NULL;
 
-    if (rank == 0) {
-        if (parse_arguments(argc, argv, &folder_path) != 0) {
-            return 1;
+    if (mode == SCHEDULE_STATIC) {
+        // With --shm the files are dealt to nodes, and every rank of a node gets the same ones
+        int num_units = shm.enabled ? shm.nb_nodes : num_tasks;
+        int unit = shm.enabled ? shm.node_index : rank;
+        s->file_idxs = files_for_rank(nb_files - first_file, num_units, unit, &s->num_files_for_rank);
+        for (int i = 0; i < s->num_files_for_rank; i++) {
+            s->file_idxs[i] += first_file;
         }
-
-        if (scan_directory(folder_path, &file_list) != 0) {
-            return 1;
+    } else if (mode == SCHEDULE_SPLIT) {
+        s->next = first_file;
+        s->num_files_for_rank = nb_files;  // Every rank takes part in every file
+    } else {
+        // Only rank 0 exposes memory; the others attach with a zero-sized window
+        MPI_Aint size = (rank == 0) ? sizeof(int) : 0;
+        MPI_Win_allocate(size, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &s->counter, &s->win);
+        if (rank == 0) {
+            *s->counter = first_file;
         }
+        MPI_Barrier(MPI_COMM_WORLD);  // Counter must be initialised before anybody fetches
+    }
+}
+
+// Return the index of the next file this rank should process, or -1 when none are left
+int scheduler_next(FileScheduler *s) {
+    if (s->mode == SCHEDULE_STATIC) {
+        return (s->next < s->num_files_for_rank) ? s->file_idxs[s->next++] : -1;
+    }
+    if (s->mode == SCHEDULE_SPLIT) {
+        return (s->next < s->num_files_for_rank) ? s->next++ : -1;
+    }
 
-        printf("Files found: %d\n", file_list.nb_files);
+    // With --shm the node leader claims for the whole node
+    int one = 1;
+    int idx;
+    double start = omp_get_wtime();
+    if (!shm.enabled || shm.node_rank == 0) {
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, s->win);
+        MPI_Fetch_and_op(&one, &idx, MPI_INT, 0, 0, MPI_SUM, s->win);
+        MPI_Win_unlock(0, s->win);
+    }
+    if (shm.enabled) {
+        MPI_Bcast(&idx, 1, MPI_INT, 0, shm.node_comm);
     }
+    double end = omp_get_wtime();
+    s->wait_time += end - start;
+    trace_span("claim", 0, -1, start, end, 0, 0, 0);
+
+    return (idx < s->nb_files) ? idx : -1;
+}
 
-    // Broadcast the file list to all processes from process 0
-    MPI_Bcast(&file_list, sizeof(FileList), MPI_BYTE, 0, MPI_COMM_WORLD);
+void scheduler_free(FileScheduler *s) {
+    if (s->mode == SCHEDULE_STATIC) {
+        free(s->file_idxs);
+    } else if (s->mode == SCHEDULE_DYNAMIC) {
+        MPI_Win_free(&s->win);
+    }
+}
 
+// Process files [first_file, file_list->nb_files) with every rank (collective). The outputs of
+// every file are written when it returns; the timings are added to *stats.
+int process_files(const Options *opts, const FileList *file_list, int first_file, int rank, int num_tasks,
+                  int num_threads, RankStats *stats) {
+    FileScheduler scheduler;
+    scheduler_init(&scheduler, opts->schedule, first_file, file_list->nb_files, num_tasks, rank);
+    if (opts->aggregate != AGGREGATE_NONE) {
+        aggregate_add_files(&aggregate, opts, file_list, first_file);
+    }
 
-    
-    int num_files_for_rank; // To hold the number of files for this rank
-    int* file_idxs = files_for_rank(file_list.nb_files, num_tasks, rank, &num_files_for_rank);
+    FileResult *pending = NULL;  // Split mode: file whose reduction is still in flight
+    Prefetcher prefetcher = {0};
+    Writer writer = {0};
+    Writer *output_writer = opts->pipeline ? &writer : NULL;
 
-    for (int i = 0; i < num_files_for_rank; i++) {
+    int file_idx = scheduler_next(&scheduler);
+    if (opts->pipeline && file_idx >= 0) {
+        char first_filename[MAX_FILENAME_LENGTH];
+        build_input_filename(file_list, file_idx, first_filename);
+        prefetcher_start(&prefetcher, first_filename, file_idx, opts->reader);
+    }
+
+    while (1) {
+        // --container: the results finished so far are written collectively before the next file
+        if (opts->container_path != NULL) {
+            double round_start = omp_get_wtime();
+            int active = container_round(&container, file_idx >= 0);
+            stats->phase_time[PHASE_OUTPUT] += omp_get_wtime() - round_start;
+            if (active < 0) {
+                return 1;
+            }
+            if (!active) {
+                break;
+            }
+            if (file_idx < 0) {
+                continue;
+            }
+        } else if (file_idx < 0) {
+            break;
+        }
+        int next_idx = -1;
 
         
-        printf("Rank %d : File %s\n", rank, file_list.file_names[file_idxs[i]]);
+        printf("Rank %d : File %s\n", rank, file_list_name(file_list, file_idx));
         
         char bin_filename[MAX_FILENAME_LENGTH] = {0};
 
-        strncpy(bin_filename, file_list.file_names[file_idxs[i]], MAX_FILENAME_LENGTH - 1);
+        strncpy(bin_filename, file_list_name(file_list, file_idx), MAX_FILENAME_LENGTH - 1);
 
         // Extract base name from input file
         
@@ -216,298 +3726,579 @@ int main(int argc, char *argv[]) {
         get_base_name(bin_filename, base_name);
 
         char input_filename[MAX_FILENAME_LENGTH];
-        snprintf(input_filename, sizeof(input_filename), "%s/%s", file_list.folder_name, bin_filename);
+        build_input_filename(file_list, file_idx, input_filename);
         
 
         double all_start_time;
         all_start_time = omp_get_wtime();
 
 
-        // Construct the output file name
-        
-        char output_filename[MAX_FILENAME_LENGTH];
-        #ifdef HISTOGRAMS
-            snprintf(output_filename, sizeof(output_filename), "histograms/occ_%s.bin", base_name);
-        #endif
+        // Construct the output file names
         
-        #ifdef HEATMAPS
-            snprintf(output_filename, sizeof(output_filename), "heatmaps/map_%s.bin", base_name);
-        #endif
+        FileResult *result = new_file_result(opts, base_name);
+        result->owner = file_owner(opts, file_idx, rank, num_tasks);
+        result->file_idx = file_idx;
+        trace.file_idx = file_idx;
 
-        printf("Output File Name: %s\n", output_filename);
+        if (result->owner == rank && opts->container_path == NULL) {
+            if (opts->histograms) {
+                printf("Output File Name: %s\n", result->hist_filename);
+            }
+            if (opts->heatmaps) {
+                printf("Output File Name: %s\n", result->heat_filename);
+            }
+        }
 
-        // Open the BIN file
-        FILE *file = fopen(input_filename, "rb");
-        if (!file) {
+        // Open the BIN file (mapped once for the whole rank unless the fread reader is used)
+        double phase_start = omp_get_wtime();
+        EventFile ef;
+        int header_status;
+        if (opts->pipeline) {
+            header_status = prefetcher_wait(&prefetcher, &ef);
+
+            // Claim the next file and start loading it while this one is being accumulated
+            next_idx = scheduler_next(&scheduler);
+            if (next_idx >= 0) {
+                char next_filename[MAX_FILENAME_LENGTH];
+                build_input_filename(file_list, next_idx, next_filename);
+                prefetcher_start(&prefetcher, next_filename, next_idx, opts->reader);
+            }
+        } else {
+            header_status = open_event_file(input_filename, opts->reader, &ef);
+            if (header_status == 0 && numa.interleave_input) {
+                warm_interleaved(&numa, input_filename, &ef.mapped);
+            }
+        }
+        if (header_status != 0) {
             printf("Error: Could not open input file %s\n", input_filename);
             return 1;
         }
+        printf("Total Events: %u\n", ef.total_events);
 
-        unsigned int total_events;
-        fread(&total_events, sizeof(unsigned int), 1, file);
-        printf("Total Events: %u\n", total_events);
-
-        
-        uint64_t first_timestamp = 0;
-        fread(&first_timestamp, sizeof(uint64_t), 1, file);
         #ifdef DEBUGGER
-            printf("*** Very First Timestamp: %lu\n", first_timestamp);
+            printf("*** Very First Timestamp: %lu\n", ef.first_timestamp);
         #endif
 
-                
-        long *start_positions;
-        calculate_start_positions(num_threads, total_events, &start_positions);
-
-        fclose(file);  // Close the shared file pointer since each thread will open its own
-
-
-        
-        /********************************************************************************************/
-        /*              PREPARING SHARED MEMORIES FOR PARALLEL-PROCESSING WITH OPEN_MP              */
-        /********************************************************************************************/
+        // Where every bin starts, if the file is known to be sorted: from the sidecar index,
+        // or searched in the mapping of a columnar file flagged as sorted. Only the owner looks
+        // for them and shares them with the ranks of the file: all of them in split mode, or
+        // the ranks of its node with --shm.
+        uint64_t *bin_starts = NULL;
+        if (result->owner == rank) {
+            int unsorted;
+            bin_starts = load_time_index(input_filename, &ef, &unsorted);
+            if (bin_starts == NULL && !unsorted && opts->build_index) {
+                bin_starts = build_time_index(input_filename, &ef, opts->reader, num_threads, &unsorted);
+                if (bin_starts != NULL || unsorted) {
+                    write_time_index(input_filename, &ef, bin_starts);
+                }
+            }
+            if (bin_starts == NULL && (ef.flags & COLUMNAR_FLAG_SORTED) && opts->reader == READER_MMAP) {
+                bin_starts = search_bin_starts(&ef);
+            }
+        }
+        if (opts->schedule == SCHEDULE_SPLIT) {
+            bin_starts = share_time_index(bin_starts, result->owner, MPI_COMM_WORLD);
+        } else if (shm.enabled) {
+            bin_starts = share_time_index(bin_starts, 0, shm.node_comm);  // Node leader
+        }
 
-        #ifdef HISTOGRAMS
-            // Initialize arrays for counting occurrences
-            unsigned int *occurrences_private = malloc(num_threads * MILLIS * sizeof(unsigned int));  // Private arrays for each thread
-            memset(occurrences_private, 0, num_threads * MILLIS * sizeof(unsigned int));
-        #endif
+        // Narrow the events to the time window with the bin starts; without them, the whole
+        // file is decoded and filtered
+        long first_event = 0;
+        long last_event = ef.total_events;
+        int filter_window = 0;
+        if (opts->t_start > 0 || opts->t_end < MILLIS) {
+            if (bin_starts != NULL) {
+                first_event = (long)bin_starts[opts->t_start];
+                last_event = (long)bin_starts[opts->t_end];
+                printf("Time window [%d, %d) bins: events %ld to %ld\n", opts->t_start, opts->t_end, first_event, last_event);
+            } else {
+                printf("Time window [%d, %d) bins: no index for %s, scanning the whole file\n",
+                       opts->t_start, opts->t_end, input_filename);
+                filter_window = 1;
+            }
+        }
 
+        // Events handled by this rank: all of them, or this rank's share in split mode or of its
+        // node with --shm (whole columnar blocks only, so that no block is decoded twice)
+        if (opts->schedule == SCHEDULE_SPLIT || shm.enabled) {
+            int split = (opts->schedule == SCHEDULE_SPLIT);
+            long align = (ef.format == FORMAT_COLUMNAR) ? (long)ef.block_events : 1;
+            long lo = first_event, hi = last_event;
+            first_event = split_bound(lo, hi, split ? rank : shm.node_rank, split ? num_tasks : shm.node_size, align);
+            last_event = split_bound(lo, hi, split ? rank + 1 : shm.node_rank + 1, split ? num_tasks : shm.node_size, align);
+        }
 
-        #ifdef HEATMAPS
+        stats->phase_time[PHASE_OPEN] += omp_get_wtime() - phase_start;
+        trace_span("open", 0, file_idx, phase_start, omp_get_wtime(), ef.total_events, ef.file_size, 0);
 
-            // Allocate a contiguous block for the entire 3D matrix
-            unsigned int ***heatmap_3d = (unsigned int ***)malloc(num_threads * sizeof(unsigned int **));
-            unsigned int *data_block_3d = (unsigned int *)malloc(num_threads * WIDTH * HEIGHT * sizeof(unsigned int));
+        // With --shm this rank's part goes to its slot of the node window first
+        unsigned int *occurrences = result->occurrences;
+        unsigned int *heatmap = result->data_block_2d;
+        DirtyRange *heat_dirty = &result->heat_dirty;
+        if (shm.enabled) {
+            occurrences = shm.slots[shm.node_rank];
+            heatmap = occurrences + MILLIS;
+            heat_dirty = &shm.slot_dirty;
+            clear_dirty_rows(heatmap, HEIGHT, heat_dirty);
+        }
 
-            // Check if allocation was successful
-            if (heatmap_3d == NULL || data_block_3d == NULL) {
-                fprintf(stderr, "Memory allocation failed\n");
-                exit(EXIT_FAILURE);
+        // --frames: the first window of frames is filled by the same pass
+        FrameWindow window = {0};
+        int nb_frames = 0;
+        if (opts->frame_bins > 0) {
+            int capacity, per_thread;
+            frame_layout(opts, num_threads, &nb_frames, &capacity, &per_thread);
+            size_t window_pixels = (size_t)capacity * WIDTH * HEIGHT;
+            if (accumulators.frame_stack == NULL) {
+                accumulators.frame_stack = malloc(window_pixels * sizeof(unsigned int));
+                if (per_thread) {
+                    accumulators.frame_partials = malloc((size_t)num_threads * window_pixels * sizeof(unsigned int));
+                }
+                if (accumulators.frame_stack == NULL || (per_thread && accumulators.frame_partials == NULL)) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            window = (FrameWindow){accumulators.frame_stack, 0, capacity, (uint64_t)opts->frame_bins * BIN_US,
+                                   accumulators.frame_partials};
+            if (!per_thread) {
+                memset(window.stack, 0, window_pixels * sizeof(unsigned int));
             }
+        }
+
+        double reduce_time;
+        OutOfRange dropped;
+        double read_time = accumulate_events(opts, input_filename, &ef, first_event, last_event, filter_window,
+                                             bin_starts, num_threads, occurrences, heatmap, heat_dirty,
+                                             opts->frame_bins > 0 ? &window : NULL, &dropped, &reduce_time);
+        if (dropped.late > 0 || dropped.outside > 0) {
+            printf("Out of range in %s: %ld events after bin %d, %ld outside the %dx%d sensor\n",
+                   input_filename, dropped.late, MILLIS, dropped.outside, WIDTH, HEIGHT);
+        }
+        stats->dropped.late += dropped.late;
+        stats->dropped.outside += dropped.outside;
+        if (shm.enabled) {
+            double shm_start = omp_get_wtime();
+            shm_reduce(&shm, result, opts);
+            reduce_time += omp_get_wtime() - shm_start;
+        }
 
-            // Initialize the entire block to 0 using memset
-            memset(data_block_3d, 0, num_threads * WIDTH * HEIGHT * sizeof(unsigned int));
+        // --frames: every further window takes one more pass, over the events of its bins only
+        // when the bin starts are known
+        if (opts->frame_bins > 0) {
+            int capacity = window.count;
+            while (1) {
+                phase_start = omp_get_wtime();
+                int rc = finish_frame_window(opts, &window, base_name, result->owner, file_idx, rank);
+                stats->phase_time[PHASE_OUTPUT] += omp_get_wtime() - phase_start;
+                if (rc != 0) {
+                    return 1;
+                }
+                window.first += window.count;
+                if (window.first >= nb_frames) {
+                    break;
+                }
+                window.count = nb_frames - window.first < capacity ? nb_frames - window.first : capacity;
+                if (window.partials == NULL) {
+                    memset(window.stack, 0, (size_t)window.count * WIDTH * HEIGHT * sizeof(unsigned int));
+                }
 
-            // Set up the pointers for the 3D array
-            for (int i = 0; i < num_threads; i++) {
-                heatmap_3d[i] = (unsigned int **)malloc(WIDTH * sizeof(unsigned int *));
-                for (int j = 0; j < WIDTH; j++) {
-                    // Each 2D slice points to the correct position in the contiguous block
-                    heatmap_3d[i][j] = data_block_3d + (i * WIDTH * HEIGHT) + (j * HEIGHT);
+                int lo_bin = window.first * opts->frame_bins;
+                int hi_bin = (window.first + window.count) * opts->frame_bins;
+                hi_bin = hi_bin < MILLIS ? hi_bin : MILLIS;
+                if (hi_bin <= opts->t_start || lo_bin >= opts->t_end) {
+                    continue;  // Outside the time window: nothing to decode
+                }
+                long lo = first_event, hi = last_event;
+                if (bin_starts != NULL) {
+                    lo = (long)bin_starts[lo_bin] > lo ? (long)bin_starts[lo_bin] : lo;
+                    hi = (long)bin_starts[hi_bin] < hi ? (long)bin_starts[hi_bin] : hi;
+                }
+                if (lo < hi) {
+                    read_time += accumulate_frame_window(opts, input_filename, &ef, lo, hi, filter_window,
+                                                         num_threads, &window);
                 }
             }
+        }
+        free(bin_starts);
 
-        #endif
+        long rank_file_events = last_event - first_event;
+        stats->events += rank_file_events;
+        stats->read_time += read_time;
+        stats->bytes += ef.total_events > 0 ? (double)ef.file_size * rank_file_events / ef.total_events : 0.0;
+        stats->phase_time[PHASE_DECODE] += read_time;
+        stats->phase_time[PHASE_REDUCE] += reduce_time;
+        close_event_file(&ef);
+        printf("Reader %s: %ld events in %.6f seconds (%.2f Mev/s)\n",
+               reader_name(opts->reader), rank_file_events, read_time,
+               read_time > 0 ? rank_file_events / read_time / 1e6 : 0.0);
 
 
-        
         /********************************************************************************************/
-        /*                            PARALLEL-PROCESSING WITH OPEN_MP                              */
+        /*                               SAVING DATA INTO BINARY FILE                               */
         /********************************************************************************************/
-        
-        // Set the number of OpenMP threads
-        omp_set_num_threads(num_threads);
+        phase_start = omp_get_wtime();
+        if (opts->schedule == SCHEDULE_SPLIT) {
+            // Start combining the partials at the owner and finish the previous file meanwhile
+            reduce_file_result(result, opts, rank);
+            if (pending != NULL && finish_file_result(pending, opts, rank, output_writer) != 0) {
+                return 1;
+            }
+            pending = result;
+        } else if (finish_file_result(result, opts, rank, output_writer) != 0) {
+            return 1;
+        }
+        stats->phase_time[PHASE_OUTPUT] += omp_get_wtime() - phase_start;
 
-        #pragma omp parallel // START OF MAIN PROCESSING
-        {
-            double start_time = omp_get_wtime();  // Measure time taken by each thread
+        /********************************************************************************************/
+        /*                                   PRINTING ELAPSED TIME                                  */
+        /********************************************************************************************/
+        double all_end_time = omp_get_wtime();
+        printf("\n *** Elapsed time for rank %i: %f seconds\n\n", rank, all_end_time - all_start_time);
 
-            int thread_id = omp_get_thread_num();
-            long start_pos = start_positions[thread_id];
-            long end_pos = start_positions[thread_id + 1];
+        file_idx = opts->pipeline ? next_idx : scheduler_next(&scheduler);
+    }
 
-            // Open the file separately in each thread
-            FILE *local_file = fopen(input_filename, "rb");
-            if (!local_file) {
-                printf("Error: Thread %d could not open file %s\n", thread_id, input_filename);
-            }
+    double phase_start = omp_get_wtime();
+    if (pending != NULL && finish_file_result(pending, opts, rank, output_writer) != 0) {
+        return 1;
+    }
+    if (opts->container_path != NULL &&
+        (container_round(&container, 0) < 0 || container_write_index(&container, file_list, opts, rank) != 0)) {
+        return 1;
+    }
+    if (opts->aggregate != AGGREGATE_NONE) {
+        aggregate_start(&aggregate, rank);
+    }
+    if (writer_wait(&writer) != 0) {
+        return 1;
+    }
+    if (opts->aggregate != AGGREGATE_NONE && aggregate_finish(&aggregate, opts, rank) != 0) {
+        return 1;
+    }
+    stats->phase_time[PHASE_OUTPUT] += omp_get_wtime() - phase_start;
 
-            // Move to the starting position of this thread's part
-            fseek(local_file, start_pos, SEEK_SET);
-            
-            /* Getting First Timestamp (to create [ms] bins) */ 
-            #ifdef HISTOGRAMS
+    stats->wait_time += scheduler.wait_time;
+    scheduler_free(&scheduler);
+    return 0;
+}
 
-                int is_first_row = 1;
+static volatile sig_atomic_t stop_requested;  // --watch: set by SIGINT, SIGTERM or SIGUSR1
 
-                fseek(local_file, start_pos, SEEK_SET);
+static void request_stop(int signum) {
+    (void)signum;
+    stop_requested = 1;
+}
 
-                rewind(local_file);
-                fseek(local_file, start_pos, SEEK_SET);
+// --watch: stop after the current batch on SIGINT or SIGTERM, or on SIGUSR1 (which mpirun forwards
+// to every rank, whereas it turns the other two into a kill of the whole job)
+void install_stop_handlers(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;  // No SA_RESTART: a pending poll() returns at once
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
+}
 
-            #endif
+// Watch a folder for recordings that are closed after writing or moved in. Set up before the
+// folder is scanned so that nothing landing in between is missed (a recording still being written
+// during the scan is processed again once it is closed).
+int watch_open(const char *folder_path) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, folder_path, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        perror("inotify");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
 
+int file_list_contains(const FileList *file_list, const char *name) {
+    for (int i = 0; i < file_list->nb_files; i++) {
+        if (strcmp(file_list_name(file_list, i), name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-            /* Read the part assigned to this thread */
-            while (ftell(local_file) < end_pos) {
-                uint64_t timestamp;
-                unsigned short x, y;
+// Wait until recordings land in the watched folder (or a stop is requested) and add every one
+// reported so far to batch, once each. Hidden files (usually written under a temporary name and
+// renamed once complete) and time indexes are skipped. Returns the number of recordings added.
+int watch_collect(int watch_fd, FileList *batch) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
 
-                // Read each event: timestamp (64 bits) and x, y (16 bits each)
-                fread(&timestamp, sizeof(uint64_t), 1, local_file);
-                fread(&x, sizeof(unsigned short), 1, local_file);
-                fread(&y, sizeof(unsigned short), 1, local_file);
+    while (batch->nb_files == 0 && !stop_requested) {
+        struct pollfd pfd = {watch_fd, POLLIN, 0};
+        if (poll(&pfd, 1, WATCH_POLL_MS) <= 0) {
+            continue;  // Timeout or signal
+        }
 
+        ssize_t length;
+        while ((length = read(watch_fd, buffer, sizeof(buffer))) > 0) {
+            const struct inotify_event *event;
+            for (char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + event->len) {
+                event = (const struct inotify_event *)p;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    printf("Warning: Watch queue overflowed, some recordings were not seen\n");
+                }
+                if (event->len == 0 || (event->mask & IN_ISDIR) || event->name[0] == '.' ||
+                    is_index_file(event->name) || file_list_contains(batch, event->name)) {
+                    continue;
+                }
+                file_list_add(batch, event->name, 0, 0);
+            }
+        }
+    }
+    return batch->nb_files;
+}
 
-                #ifdef HISTOGRAMS            
-                    if (is_first_row) {
-                        is_first_row = 0;
-                    }
+// Rank 0 tells the others whether another batch follows. They poll rather than block in
+// MPI_Bcast, which keeps a core spinning in most MPI libraries while the folder is quiet.
+int bcast_watch_status(int more) {
+    MPI_Request request;
+    int done = 0;
+    MPI_Ibcast(&more, 1, MPI_INT, 0, MPI_COMM_WORLD, &request);
+    MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+    while (!done) {
+        usleep(WATCH_IDLE_SLEEP_US);
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+    }
+    return more;
+}
 
-                    uint64_t ms_interval = (timestamp - first_timestamp) / 1000;
-                    if (ms_interval < MILLIS) {
-                        occurrences_private[thread_id * MILLIS + ms_interval]++;
-                    }
-                #endif
+// --watch: process the recordings landing in the folder batch by batch until a stop is requested.
+// The OpenMP team, the per-thread partials and the output buffers are those of the first files.
+int watch_folder(const Options *opts, FileList *file_list, int watch_fd, int rank, int num_tasks,
+                 int num_threads, RankStats *stats) {
+    if (rank == 0) {
+        printf("Watching %s for new recordings\n", opts->folder_path);
+        fflush(stdout);
+    }
 
-                #ifdef HEATMAPS
-                    // Update heatmap_3d for the current thread
-                    heatmap_3d[thread_id][x][y]++;
-                #endif
-            }
+    while (1) {
+        FileList batch = {0};
+        int more = 0;
+        double arrival_time = 0.0;
+        if (rank == 0) {
+            batch.folder_name = strdup(file_list->folder_name);
+            more = watch_collect(watch_fd, &batch) > 0;
+            arrival_time = MPI_Wtime();
+        }
+        if (!bcast_watch_status(more)) {
+            free_file_list(&batch);
+            return 0;
+        }
 
-            double end_time = omp_get_wtime();  // End time measurement
+        // The new recordings are appended to the manifest, so that file indices stay unique
+        broadcast_file_list(&batch, rank);
+        read_file_info(&batch, rank, num_tasks);
+        int first_file = file_list->nb_files;
+        for (int i = 0; i < batch.nb_files; i++) {
+            file_list_add(file_list, file_list_name(&batch, i), batch.file_sizes[i], batch.total_events[i]);
+        }
+        free_file_list(&batch);
+        if (opts->schedule == SCHEDULE_DYNAMIC) {
+            sort_files_by_events(file_list, first_file);
+        }
 
-            #ifdef DEBUGGER
-                printf("Thread %d processed its part in %.6f seconds\n", thread_id, end_time - start_time);
-            #endif
+        if (process_files(opts, file_list, first_file, rank, num_tasks, num_threads, stats) != 0) {
+            return 1;
+        }
 
-            // Close the file after processing is done
-            fclose(local_file);
+        // Latency of the live pipeline: from rank 0 seeing the recordings to all their outputs written
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("Watch: %d recording(s) written %.6f seconds after they landed\n",
+                   file_list->nb_files - first_file, MPI_Wtime() - arrival_time);
+        }
+        fflush(stdout);
+    }
+}
 
-        } // End of OpenMP Parallel Processing
+int main(int argc, char *argv[]) {
 
+    Options opts;
+    FileList file_list = {0};  // Initialize with zero files (grown by the scan or the manifest)
+    
+    int num_tasks, rank, rc;
+    double mpi_start_time, mpi_end_time, mpi_elapsed_time, mpi_max_elapsed_time;
 
-        
-        /********************************************************************************************/
-        /*                       CONSOLIDATING DATA FROM OPEN_MP PROCESSES                          */
-        /********************************************************************************************/
+    // Initialize MPI
+    rc = MPI_Init(&argc, &argv);
+    if (rc != MPI_SUCCESS) {
+        printf("Error starting MPI program. Terminating.\n");
+        MPI_Abort(MPI_COMM_WORLD, rc);
+    }
 
+    // Record the start time
+    mpi_start_time = MPI_Wtime();
 
+    // Get the number of MPI tasks and the rank of this process
+    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-        #ifdef HISTOGRAMS
-        unsigned int occurrences[MILLIS] = {0};  // Final array to store the results
-
-
-            /****************************************************************************************/
-            /*                            OFFLOADING ARRAY OPERATION TO GPU                         */
-            /****************************************************************************************/
-            #ifdef OFFLOADGPU
-            #pragma omp target data map(to: occurrences_private[0:num_threads * MILLIS]) \
-                                map(from: occurrences[0:MILLIS])
-            {
-                
-                #pragma omp target teams distribute parallel for reduction(+:occurrences[:MILLIS])
-            #endif // OFFLOADGPU
-                for (int j = 0; j < MILLIS; j++) {
-                    unsigned int sum = 0;
-                    for (int i = 0; i < num_threads; i++) {
-                        sum += occurrences_private[i * MILLIS + j];
-                    }
-                    occurrences[j] = sum;
-                    #ifdef DEBUGGER
-                        if(j > MILLIS/num_threads*99/100 && j < MILLIS/num_threads*101/100){
-                            printf("Total occurrences at [ms] %d: %d\n", j, sum);
-                        }
-                    #endif
-                }
-            #ifdef OFFLOADGPU
-            }
-            #endif // OFFLOADGPU
-        #endif
+    printf("Available MPI tasks: %d\n", num_tasks);
 
-        #ifdef HEATMAPS
-            // Allocate a contiguous block for the 2D matrix
-            unsigned int *data_block_2d = (unsigned int *)malloc(WIDTH * HEIGHT * sizeof(unsigned int));
-            unsigned int **heatmap_2d = (unsigned int **)malloc(WIDTH * sizeof(unsigned int *));
-            
-            memset(data_block_2d, 0, WIDTH * HEIGHT * sizeof(unsigned int));
+    /********************************************************************************************/
+    /*           PARSING ARGUMENTS, SETTING OUTPUT FILE NAMES, OPENING INPUT FILE, ETC          */
+    /********************************************************************************************/
 
-            // Set up the pointers for the 2D array
-            for (int i = 0; i < WIDTH; i++) {
-                heatmap_2d[i] = data_block_2d + (i * HEIGHT);
-            }
 
-            /****************************************************************************************/
-            /*                            OFFLOADING MATRIX OPERATION TO GPU                        */
-            /****************************************************************************************/
-            
-            #ifdef OFFLOADGPU
-            // Map the base pointers and the data blocks to the GPU
-            #pragma omp target data map(to: heatmap_3d[0:num_threads]) \
-                                map(to: data_block_3d[0:num_threads * WIDTH * HEIGHT]) \
-                                map(from: data_block_2d[0:WIDTH * HEIGHT])
-            {
-                // Offload computation to GPU
-                #pragma omp target teams distribute parallel for collapse(2)
-            #endif // OFFLOADGPU
-                for (int x = 0; x < WIDTH; x++) {
-                    for (int y = 0; y < HEIGHT; y++) {
-                        unsigned int sum = 0;
-                        for (int i = 0; i < num_threads; i++) {
-                            // Use directly the data block to avoid potential issues with pointer dereferencing
-                            sum += data_block_3d[(i * WIDTH * HEIGHT) + (x * HEIGHT) + y];
-                        }
-                        data_block_2d[x * HEIGHT + y] = sum;
-                    }
-                }
-            #ifdef OFFLOADGPU
-            }
-            #endif // OFFLOADGPU
+    int num_threads = 1;
+    num_threads = omp_get_max_threads();  // Use maximum number of threads allowed by OpenMP runtime
+    printf("Available OpenMP Threads: %d\n", num_threads);
 
-        #endif
+    // Every rank parses the (identical) command line so the options need no broadcast
+    if (parse_arguments(argc, argv, &opts, rank == 0) != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+    geometry = opts.geometry;
+    trace_init(opts.trace_path);
 
-        
-        /********************************************************************************************/
-        /*                               SAVING DATA INTO BINARY FILE                               */
-        /********************************************************************************************/
-        FILE *output_file = fopen(output_filename, "wb");
-        if (!output_file) {
-            printf("Error: Could not create output file.bin\n");
-            return 1;
+    // Pin the threads once: the OpenMP runtime keeps the same threads for every file
+    read_numa_topology(&numa);
+    numa.interleave_input = (opts.numa_input == NUMA_INPUT_INTERLEAVE && numa.nb_nodes > 1);
+    if (opts.pin) {
+        pin_threads(&numa, num_threads);
+    }
+    report_numa_topology(&numa, &opts, rank, num_threads);
+    if (opts.shm) {
+        shm_init(&shm, rank);
+        if (rank == 0) {
+            printf("Shared memory: %d node(s), %d rank(s) on node 0 share every file through a %.2f MB window\n",
+                   shm.nb_nodes, shm.node_size,
+                   shm.node_size * (MILLIS + WIDTH * HEIGHT) * sizeof(unsigned int) / (1024.0 * 1024.0));
         }
+    }
 
-        #ifdef HISTOGRAMS
-            fwrite(occurrences, sizeof(unsigned int), MILLIS, output_file);
-        #endif
+    if (opts.histograms) {
+        printf("This program creates Histograms\n");
+    }
 
-        #ifdef HEATMAPS
-            fwrite(data_block_2d, sizeof(unsigned int), WIDTH * HEIGHT, output_file);
-        #endif
-        fclose(output_file);
-        printf("Data saved to %s\n", output_filename);
-        
+    if (opts.heatmaps) {
+        printf("This program creates Heatmaps\n");
+        printf("Heatmap accumulation: %s (%.2f MB per rank)\n", heat_accum_name(opts.heat_accum),
+               heat_accum_footprint(opts.heat_accum, num_threads) / (1024.0 * 1024.0));
+    }
 
-        /********************************************************************************************/
-        /*                                 FREEING ALLOCATED MEMORY                                 */
-        /********************************************************************************************/
-        #ifdef HISTOGRAMS
-            free(occurrences_private);
-        #endif
+    double manifest_start_time = MPI_Wtime();
+    int list_status = 0;
+    int watch_fd = -1;
+    if (opts.watch) {
+        install_stop_handlers();
+    }
+    if (rank == 0) {
+        printf("Input reader: %s\n", reader_name(opts.reader));
 
-        #ifdef HEATMAPS
-            free(data_block_3d);
-            for (int i = 0; i < num_threads; i++) {
-                free(heatmap_3d[i]);
-            }
-            free(heatmap_3d);
-            free(data_block_2d);
-            free(heatmap_2d);
-        #endif
-        free(start_positions);
+        file_list.folder_name = strdup(opts.folder_path);
+        if (opts.watch && (watch_fd = watch_open(opts.folder_path)) < 0) {
+            list_status = -1;
+        } else if (opts.manifest_path != NULL) {
+            list_status = load_manifest(opts.manifest_path, &file_list);
+        } else {
+            list_status = scan_directory(opts.folder_path, &file_list);
+        }
+    }
+    MPI_Bcast(&list_status, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (list_status != 0) {
+        MPI_Finalize();
+        return 1;
+    }
 
-        /********************************************************************************************/
-        /*                                   PRINTING ELAPSED TIME                                  */
-        /********************************************************************************************/
-        double all_end_time = omp_get_wtime();
-        printf("\n *** Elapsed time for rank %i: %f seconds\n\n", rank, all_end_time - all_start_time);
+    // Broadcast the names from process 0, then read the sizes and event counts on all processes
+    broadcast_file_list(&file_list, rank);
+    read_file_info(&file_list, rank, num_tasks);
+    if (opts.schedule == SCHEDULE_DYNAMIC) {
+        sort_files_by_events(&file_list, 0);  // Same order on every rank
+    }
+
+    if (rank == 0) {
+        unsigned long long total_events = 0;
+        double total_bytes = 0.0;
+        for (int i = 0; i < file_list.nb_files; i++) {
+            total_events += file_list.total_events[i];
+            total_bytes += (double)file_list.file_sizes[i];
+        }
+        printf("Files found: %d (%llu events, %.2f MB) in %f seconds\n", file_list.nb_files, total_events,
+               total_bytes / (1024.0 * 1024.0), MPI_Wtime() - manifest_start_time);
+    }
+
+    if (opts.container_path != NULL && container_open(&container, opts.container_path, &opts) != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    RankStats stats = {0};
+    if (process_files(&opts, &file_list, 0, rank, num_tasks, num_threads, &stats) != 0) {
+        return 1;
+    }
+    if (opts.watch) {
+        if (watch_folder(&opts, &file_list, watch_fd, rank, num_tasks, num_threads, &stats) != 0) {
+            return 1;
+        }
+        if (watch_fd >= 0) {
+            close(watch_fd);
+        }
     }
 
-    free(file_idxs); // Free the allocated memory
+    printf("Rank %d reader %s: %llu events, %.2f Mev/s\n", rank, reader_name(opts.reader), stats.events,
+           stats.read_time > 0 ? stats.events / stats.read_time / 1e6 : 0.0);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Rank %d peak RSS: %.2f MB\n", rank, usage.ru_maxrss / 1024.0);
 
     // Record the end time
     mpi_end_time = MPI_Wtime();
 
+    // Idle time = waiting for file indices + waiting for the slowest rank to finish
+    double barrier_start = omp_get_wtime();
+    MPI_Barrier(MPI_COMM_WORLD);
+    trace_span("barrier", 0, -1, barrier_start, omp_get_wtime(), 0, 0, 0);
+    double idle_time = stats.wait_time + (MPI_Wtime() - mpi_end_time);
+
+    double *idle_times = NULL;
+    if (rank == 0) {
+        idle_times = malloc(num_tasks * sizeof(double));
+    }
+    MPI_Gather(&idle_time, 1, MPI_DOUBLE, idle_times, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        double max_idle = 0.0;
+        for (int r = 0; r < num_tasks; r++) {
+            printf("Rank %d idle time (%s schedule): %f seconds\n", r,
+                   schedule_name(opts.schedule), idle_times[r]);
+            if (idle_times[r] > max_idle) {
+                max_idle = idle_times[r];
+            }
+        }
+        printf("Maximum idle time: %f seconds\n", max_idle);
+        free(idle_times);
+    }
+
+    // Throughput of every phase over all ranks: total events and bytes over the slowest rank's time
+    double max_phase_time[NB_PHASES];
+    double rank_totals[4] = {(double)stats.events, stats.bytes, (double)stats.dropped.late, (double)stats.dropped.outside};
+    double totals[4];
+    MPI_Reduce(stats.phase_time, max_phase_time, NB_PHASES, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(rank_totals, totals, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (int p = 0; p < NB_PHASES; p++) {
+            double t = max_phase_time[p];
+            printf("Phase %s: %.6f seconds, %.2f Mev/s, %.2f MB/s\n", phase_names[p], t,
+                   t > 0 ? totals[0] / t / 1e6 : 0.0, t > 0 ? totals[1] / t / 1e6 : 0.0);
+        }
+        printf("Geometry: %dx%d sensor, %d bins of %" PRIu64 " us; out of range: %.0f events late, %.0f outside\n",
+               WIDTH, HEIGHT, MILLIS, BIN_US, totals[2], totals[3]);
+    }
+
     // Calculate elapsed time for each process
     mpi_elapsed_time = mpi_end_time - mpi_start_time;
 
@@ -527,13 +4318,12 @@ int main(int argc, char *argv[]) {
         // Collect messages from other processes
         printf("This is it my friend\n");
         
-        #ifdef HISTOGRAMS
-        const char *file_name = "summary_histograms.csv";
-        #endif
-        
-        #ifdef HEATMAPS
-        const char *file_name = "summary_heatmaps.csv";
-        #endif
+        const char *file_name = "summary_fused.csv";
+        if (!opts.heatmaps) {
+            file_name = "summary_histograms.csv";
+        } else if (!opts.histograms) {
+            file_name = "summary_heatmaps.csv";
+        }
 
         // Open the CSV file in append mode
         FILE *summary_file = fopen(file_name, "a");
@@ -554,6 +4344,20 @@ int main(int argc, char *argv[]) {
         fclose(summary_file);
     }
 
+    if (opts.trace_path != NULL && trace_write(opts.trace_path, &file_list, rank, num_tasks) != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (opts.container_path != NULL) {
+        MPI_File_close(&container.fh);
+    }
+    free_file_list(&file_list);
+    free_accumulators(&accumulators);
+    free_result_pool();
+    free_aggregate(&aggregate);
+    shm_free(&shm);
+
     // Finalize MPI
     MPI_Finalize();
 
@@ -2,26 +2,28 @@ import numpy as np
 import matplotlib.pyplot as plt
 import sys
 import os
-
-def plot_occurrences(file_path, output_png):
-    # Load binary data
-    data = np.fromfile(file_path, dtype=np.uint32)
+from container_reader import is_container, load_histogram
+
+def plot_occurrences(file_path, output_png, base_name=None):
+    # Load binary data (a record of a --container file when a base name is given)
+    if base_name is not None:
+        data = load_histogram(file_path, base_name)
+    else:
+        data = np.fromfile(file_path, dtype=np.uint32)
     A = np.mean(data)
     S = np.std(data)
 
     # Limit data
     data = np.clip(data, None, A + 3*S)
 
-    # Define the number of milliseconds (10000)
-    num_milliseconds = 2000
-    
-    if len(data) != num_milliseconds:
-        raise ValueError(f"Expected {num_milliseconds} elements, but found {len(data)}")
+    # One element per bin (2000 with the default --duration and --bin-us)
+    if len(data) == 0:
+        raise ValueError(f"No bins found in {file_path}")
 
     # Plotting
     plt.figure(figsize=(12, 6))
     plt.plot(data/1000, marker='o', linestyle='-', color='b')
-    plt.xlabel('t [ms]')
+    plt.xlabel('t [bin]')
     plt.ylabel('Activity [Mev/s]')
     plt.grid(True)
     
@@ -31,11 +33,12 @@ def plot_occurrences(file_path, output_png):
 
 if __name__ == "__main__":
     # Check if the input file name is provided
-    if len(sys.argv) != 2:
-        print("Usage: python script_name.py <input_file>")
+    if len(sys.argv) not in (2, 3):
+        print("Usage: python script_name.py <input_file> | <container> <base_name>")
         sys.exit(1)
 
     input_file = sys.argv[1]
+    base_name = sys.argv[2] if len(sys.argv) == 3 and is_container(input_file) else None
 
     # Create output directory if it doesn't exist
     output_dir = 'images'
@@ -43,6 +46,8 @@ if __name__ == "__main__":
 
     # Determine the output file name by replacing the .bin extension with .png and adding the directory path
     output_file = os.path.join(output_dir, os.path.splitext(os.path.basename(input_file))[0] + '.png')
+    if base_name is not None:
+        output_file = os.path.join(output_dir, 'occ_' + base_name + '.png')
 
     # Call the plotting function
-    plot_occurrences(input_file, output_file)
+    plot_occurrences(input_file, output_file, base_name)
@@ -2,17 +2,24 @@ import numpy as np
 import matplotlib.pyplot as plt
 import sys
 import os
+from container_reader import is_container, load_heatmap
+from hmz_reader import load_hmz
 
 '''
 This Script creates a HeatMaps (from matrices in *.bin format)
 '''
 
 # Check if the input file name is provided
-if len(sys.argv) != 2:
-    print("Usage: python hm_plotter.py <input_file>")
+if len(sys.argv) not in (2, 3):
+    print("Usage: python hm_plotter.py <input_file> [WxH] | <container> <base_name>")
     sys.exit(1)
 
 input_file = sys.argv[1]
+base_name = sys.argv[2] if len(sys.argv) == 3 and is_container(input_file) else None
+# Sensor size of a dense .bin heatmap (640x480 unless given)
+width, height = 640, 480
+if len(sys.argv) == 3 and base_name is None:
+    width, height = map(int, sys.argv[2].split('x'))
 
 # Create output directory if it doesn't exist
 output_dir = 'images'
@@ -20,10 +27,17 @@ os.makedirs(output_dir, exist_ok=True)
 
 # Extract the base name of the input file (without the path) and replace the .bin extension with .png
 output_file = os.path.join(output_dir, os.path.splitext(os.path.basename(input_file))[0] + '.png')
-
-# Read the matrix data from the binary file
-with open(input_file, 'rb') as f:
-    matrix = np.fromfile(f, dtype=np.uint32).reshape((640, 480))
+if base_name is not None:
+    output_file = os.path.join(output_dir, 'map_' + base_name + '.png')
+
+# Read the matrix data from the binary file, from its record in a --container file, or from a .hmz
+if base_name is not None:
+    matrix = load_heatmap(input_file, base_name)
+elif input_file.endswith('.hmz'):
+    matrix = load_hmz(input_file)
+else:
+    with open(input_file, 'rb') as f:
+        matrix = np.fromfile(f, dtype=np.uint32).reshape((width, height))
 
 # Calculate mean and standard deviation
 mean = np.mean(matrix)
@@ -0,0 +1,44 @@
+import numpy as np
+import struct
+import sys
+
+'''
+Reads the compressed heatmaps written with --heat-format auto (map_<base>.hmz, see the
+HeatmapHeader layout in gpu_mpi_common_open_mp.c) back into a dense (width, height) matrix
+'''
+
+MAGIC = b'HMZ1'
+HEADER = struct.Struct('<4sIIIIIQ')
+ENCODINGS = ('sparse', 'dense8', 'dense16', 'dense32')
+NARROW = {'dense8': np.uint8, 'dense16': np.uint16}
+
+
+def load_hmz(path):
+    with open(path, 'rb') as f:
+        magic, version, width, height, encoding, _, nb_entries = HEADER.unpack(f.read(HEADER.size))
+        if magic != MAGIC or version != 1 or encoding >= len(ENCODINGS):
+            raise ValueError(f"{path} is not a compressed heatmap")
+        pixels = width * height
+
+        if ENCODINGS[encoding] == 'sparse':
+            matrix = np.zeros(pixels, dtype=np.uint32)
+            indices = np.fromfile(f, dtype=np.uint32, count=nb_entries)
+            matrix[indices] = np.fromfile(f, dtype=np.uint32, count=nb_entries)
+        elif ENCODINGS[encoding] in NARROW:
+            matrix = np.fromfile(f, dtype=NARROW[ENCODINGS[encoding]], count=pixels).astype(np.uint32)
+            indices = np.fromfile(f, dtype=np.uint32, count=nb_entries)
+            matrix[indices] = np.fromfile(f, dtype=np.uint32, count=nb_entries)
+        else:
+            matrix = np.fromfile(f, dtype=np.uint32, count=pixels)
+
+    return matrix.reshape((width, height))
+
+
+if __name__ == "__main__":
+    # Expand a .hmz into the dense map_<base>.bin layout
+    if len(sys.argv) != 3:
+        print("Usage: python hmz_reader.py <input.hmz> <output.bin>")
+        sys.exit(1)
+
+    load_hmz(sys.argv[1]).tofile(sys.argv[2])
+    print(f"Data saved to {sys.argv[2]}")
@@ -28,5 +28,15 @@ for nodes in "${nodes_list[@]}"; do
 
         # Run the MPI program without GPU offload
         srun -A edu24.summer -t 00:10:00 -p gpu --nodes=$nodes --ntasks-per-node=1 --cpus-per-task=$cpus_per_task ./mpi_hg_open_mp.exe --folder events
+
+        ############################################
+        #     Fused (one read for both outputs)    #
+        ############################################
+
+        # Run the MPI program using GPU offload
+        srun -A edu24.summer -t 00:10:00 -p gpu --nodes=$nodes --ntasks-per-node=1 --cpus-per-task=$cpus_per_task ./gpu_mpi_open_mp.exe --folder events --outputs hist,heat
+
+        # Run the MPI program without GPU offload
+        srun -A edu24.summer -t 00:10:00 -p gpu --nodes=$nodes --ntasks-per-node=1 --cpus-per-task=$cpus_per_task ./mpi_open_mp.exe --folder events --outputs hist,heat
     done
 done